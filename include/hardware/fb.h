@@ -30,6 +30,15 @@ __BEGIN_DECLS
 
 #define GRALLOC_HARDWARE_FB0 "fb0"
 
+/*
+ * Versions of framebuffer_device_t, in its common.version field. A device
+ * of version 0 ends after (*perform)(); the hooks added by later versions
+ * must not be accessed on it.
+ */
+#define FRAMEBUFFER_DEVICE_API_VERSION_0    0
+/* adds (*postAsync)() */
+#define FRAMEBUFFER_DEVICE_API_VERSION_1    1
+
 /*****************************************************************************/
 
 
@@ -154,6 +163,25 @@ typedef struct framebuffer_device_t {
      */
     int (*perform) (struct framebuffer_device_t* dev, int event, int value);
 
+    /*
+     * This hook is OPTIONAL, and only present when common.version is
+     * FRAMEBUFFER_DEVICE_API_VERSION_1 or later.
+     *
+     * Same as (*post)(), but returns as soon as <buffer> is queued for
+     * display instead of waiting for it to be shown, so that the next frame
+     * can be rendered meanwhile. Posts are shown in order, only a few can
+     * be pending, beyond that (*postAsync)() blocks.
+     *
+     * *releaseFd is set to a file descriptor that becomes readable once
+     * <buffer> is on screen, that is once the buffer that was shown before
+     * it has left scanout and can be rendered to again. The caller owns it
+     * and must close it. It is -1 if there is nothing to wait for.
+     *
+     * Returns 0 on success or -errno on error.
+     */
+    int (*postAsync)(struct framebuffer_device_t* dev, buffer_handle_t buffer,
+            int* releaseFd);
+
 } framebuffer_device_t;
 
 
@@ -36,6 +36,15 @@ __BEGIN_DECLS
  */
 #define SENSORS_HARDWARE_POLL       "poll"
 
+/**
+ * Versions of sensors_poll_device_t, in its common.version field.
+ * A device of version 0 ends after (*poll)(); the hooks added by later
+ * versions must not be accessed on it.
+ */
+#define SENSORS_DEVICE_API_VERSION_0    0
+/* adds (*batch)() and (*flush)() */
+#define SENSORS_DEVICE_API_VERSION_1    1
+
 /**
  * Handles must be higher than SENSORS_HANDLE_BASE and must be unique.
  * A Handle identifies a given sensors. The handle is used to activate
@@ -466,6 +475,32 @@ struct sensors_poll_device_t {
      */
     int (*poll)(struct sensors_poll_device_t *dev,
             sensors_event_t* data, int count);
+
+    /**
+     * This hook is OPTIONAL, and only present when common.version is
+     * SENSORS_DEVICE_API_VERSION_1 or later.
+     *
+     * Lets the HAL hold back events from continuous, non-wakeup sensors
+     * (accelerometer, magnetic field, ...) for up to <timeout> ns, so that
+     * (*poll)() returns them in one go instead of waking up its caller for
+     * every sample. Events from wakeup sensors such as proximity are never
+     * held back, and release everything buffered with them.
+     * A timeout of 0 disables batching.
+     *
+     * @return 0 on success, negative errno code otherwise
+     */
+    int (*batch)(struct sensors_poll_device_t *dev, int64_t timeout);
+
+    /**
+     * This hook is OPTIONAL, and only present when common.version is
+     * SENSORS_DEVICE_API_VERSION_1 or later.
+     *
+     * Makes (*poll)() return all the events currently held back by
+     * (*batch)() without waiting for the timeout.
+     *
+     * @return 0 on success, negative errno code otherwise
+     */
+    int (*flush)(struct sensors_poll_device_t *dev);
 };
 
 /** convenience API for opening and closing a device */
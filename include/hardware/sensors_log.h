@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_INCLUDE_HARDWARE_SENSORS_LOG_H
+#define ANDROID_INCLUDE_HARDWARE_SENSORS_LOG_H
+
+#include <stdint.h>
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+/* the following is the format of the compressed event log written by the
+ * sensors HAL when persist.sensors.log is set to 1.
+ *
+ * A file starts with a sensors_log_header, followed by one record per
+ * event. Values are stored as integers, in units of 1/scale, and all
+ * integers are LEB128 varints, zigzag-encoded when signed.
+ *
+ * key record (tag bit 7 set), the complete state of a sensor:
+ *      tag, type, count, status, timestamp, value[count]
+ * delta record, relative to the previous record of the same sensor:
+ *      tag, timestamp delta - previous delta, value[i] - previous value[i]
+ *
+ * The first record of each sensor in a file is a key record, and so is
+ * every SENSORS_LOG_KEY_INTERVAL-th one, or any record whose type, count
+ * or status changed, so a file can be decoded on its own. There is no
+ * marker between records, so nothing past a damaged record can be decoded;
+ * rotating the files keeps what is lost that way bounded.
+ *
+ * all definitions here are header-only, so that tools don't need to link
+ * against the HAL module.
+ */
+
+#define SENSORS_LOG_MAGIC           0x474f4c53  /* "SLOG" */
+#define SENSORS_LOG_VERSION         1
+#define SENSORS_LOG_SCALE           1000
+#define SENSORS_LOG_KEY_INTERVAL    256
+#define SENSORS_LOG_MAX_HANDLES     32
+#define SENSORS_LOG_MAX_VALUES      16
+#define SENSORS_LOG_KEY             0x80
+
+/* worst case size of one record */
+#define SENSORS_LOG_MAX_RECORD      (1 + 3*10 + 1 + SENSORS_LOG_MAX_VALUES*10)
+
+struct sensors_log_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t scale;
+    uint32_t reserved;
+};
+
+static __inline__ uint64_t
+sensors_log_zigzag(int64_t v)
+{
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static __inline__ int64_t
+sensors_log_unzigzag(uint64_t v)
+{
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static __inline__ uint8_t*
+sensors_log_put_varint(uint8_t* p, uint64_t v)
+{
+    while (v >= 0x80) {
+        *p++ = (uint8_t)v | 0x80;
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+/* Returns a pointer past the varint, or NULL if it doesn't end before <end> */
+static __inline__ const uint8_t*
+sensors_log_get_varint(const uint8_t* p, const uint8_t* end, uint64_t* v)
+{
+    uint64_t result = 0;
+    int shift = 0;
+    while (p < end && shift < 64) {
+        uint8_t b = *p++;
+        result |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *v = result;
+            return p;
+        }
+        shift += 7;
+    }
+    return NULL;
+}
+
+__END_DECLS
+
+#endif /* ANDROID_INCLUDE_HARDWARE_SENSORS_LOG_H */
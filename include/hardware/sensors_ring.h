@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_INCLUDE_HARDWARE_SENSORS_RING_H
+#define ANDROID_INCLUDE_HARDWARE_SENSORS_RING_H
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/cdefs.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include <cutils/sockets.h>
+#include <hardware/sensors.h>
+
+__BEGIN_DECLS
+
+/* the following is the client side of the sensors HAL fan-out service.
+ *
+ * When the sensors module is opened with ro.sensors.fanout set to 1, every
+ * event returned by (*poll)() is also published in a shared, read-only
+ * ring. Any number of native processes can map it and read the same
+ * hardware stream, each with its own cursor and decimation, without
+ * opening the sensors device themselves.
+ *
+ * Each slot carries the sequence number of the event it holds. A writer
+ * invalidates a slot before reusing it, so a reader that has been lapped
+ * notices it and skips ahead instead of returning a torn event.
+ *
+ * all definitions here are header-only, so that clients don't need to
+ * link against the HAL module.
+ */
+
+#define SENSORS_RING_SOCKET         "sensors_ring"
+#define SENSORS_RING_MAGIC          0x474e5253  /* "SRNG" */
+#define SENSORS_RING_CAPACITY       512         /* must be a power of 2 */
+#define SENSORS_RING_MAX_HANDLES    32
+
+struct sensors_ring_header {
+    uint32_t magic;
+    uint32_t event_size;
+    uint32_t capacity;
+    uint32_t reserved;
+    /* sequence number of the next event to be published */
+    volatile int32_t head;
+};
+
+struct sensors_ring_slot {
+    /* sequence number of the event in this slot */
+    volatile int32_t seq;
+    int32_t reserved;
+    sensors_event_t event;
+};
+
+#define SENSORS_RING_SIZE   (sizeof(struct sensors_ring_header) + \
+        SENSORS_RING_CAPACITY * sizeof(struct sensors_ring_slot))
+
+/* commands a client can send on its connection */
+enum {
+    SENSORS_RING_ACTIVATE   = 1,
+    SENSORS_RING_SET_DELAY  = 2
+};
+
+struct sensors_ring_command {
+    int32_t what;
+    int32_t handle;
+    int64_t value;
+};
+
+struct sensors_ring_reader {
+    int fd;
+    const struct sensors_ring_header* header;
+    const struct sensors_ring_slot* slots;
+    int32_t cursor;
+    /* events dropped because this reader fell more than a ring behind */
+    uint32_t lost;
+    uint32_t decimation[SENSORS_RING_MAX_HANDLES];
+    uint32_t count[SENSORS_RING_MAX_HANDLES];
+};
+
+/* Connects to the fan-out service and maps the ring. Returns 0 on success
+ * or -errno on error.
+ */
+static __inline__ int
+sensors_ring_open(struct sensors_ring_reader* r)
+{
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr* cmsg;
+    char cbuf[CMSG_SPACE(sizeof(int))];
+    char c;
+    int ringFd = -1;
+    void* base;
+
+    memset(r, 0, sizeof(*r));
+    r->fd = socket_local_client(SENSORS_RING_SOCKET,
+            ANDROID_SOCKET_NAMESPACE_ABSTRACT, SOCK_STREAM);
+    if (r->fd < 0)
+        return -errno;
+
+    /* the service sends the ring's fd as soon as we are accepted */
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = &c;
+    iov.iov_len = 1;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    if (recvmsg(r->fd, &msg, 0) == 1) {
+        cmsg = CMSG_FIRSTHDR(&msg);
+        if (cmsg && cmsg->cmsg_level == SOL_SOCKET &&
+                cmsg->cmsg_type == SCM_RIGHTS) {
+            memcpy(&ringFd, CMSG_DATA(cmsg), sizeof(int));
+        }
+    }
+    if (ringFd < 0) {
+        close(r->fd);
+        return -EPROTO;
+    }
+
+    base = mmap(0, SENSORS_RING_SIZE, PROT_READ, MAP_SHARED, ringFd, 0);
+    close(ringFd);
+    if (base == MAP_FAILED) {
+        int err = -errno;
+        close(r->fd);
+        return err;
+    }
+    r->header = (const struct sensors_ring_header*)base;
+    r->slots = (const struct sensors_ring_slot*)(r->header + 1);
+    if (r->header->magic != SENSORS_RING_MAGIC ||
+            r->header->event_size != sizeof(sensors_event_t) ||
+            r->header->capacity != SENSORS_RING_CAPACITY) {
+        munmap(base, SENSORS_RING_SIZE);
+        close(r->fd);
+        return -EPROTO;
+    }
+    /* only see what is published from now on */
+    r->cursor = r->header->head;
+    return 0;
+}
+
+static __inline__ void
+sensors_ring_close(struct sensors_ring_reader* r)
+{
+    munmap((void*)r->header, SENSORS_RING_SIZE);
+    close(r->fd);
+}
+
+/* Only return one event out of <n> for sensor <handle>, 0 or 1 for all */
+static __inline__ void
+sensors_ring_set_decimation(struct sensors_ring_reader* r, int handle,
+        uint32_t n)
+{
+    if (handle >= 0 && handle < SENSORS_RING_MAX_HANDLES) {
+        r->decimation[handle] = n;
+        r->count[handle] = 0;
+    }
+}
+
+static __inline__ int
+sensors_ring_send(struct sensors_ring_reader* r, int what, int handle,
+        int64_t value)
+{
+    struct sensors_ring_command cmd;
+    int32_t status;
+    cmd.what = what;
+    cmd.handle = handle;
+    cmd.value = value;
+    if (write(r->fd, &cmd, sizeof(cmd)) != sizeof(cmd))
+        return -errno;
+    if (read(r->fd, &status, sizeof(status)) != sizeof(status))
+        return -EPIPE;
+    return status;
+}
+
+/* Activations are reference counted by the HAL and dropped automatically
+ * when the connection goes away.
+ */
+static __inline__ int
+sensors_ring_activate(struct sensors_ring_reader* r, int handle, int enabled)
+{
+    return sensors_ring_send(r, SENSORS_RING_ACTIVATE, handle, enabled);
+}
+
+static __inline__ int
+sensors_ring_set_delay(struct sensors_ring_reader* r, int handle, int64_t ns)
+{
+    return sensors_ring_send(r, SENSORS_RING_SET_DELAY, handle, ns);
+}
+
+/* Copies up to <count> events straight out of the shared ring. Blocks for
+ * up to <timeout_ms> (forever if negative) when there is nothing to read.
+ * Returns the number of events read, which can be 0 on timeout.
+ */
+static __inline__ int
+sensors_ring_read(struct sensors_ring_reader* r, sensors_event_t* data,
+        int count, int timeout_ms)
+{
+    const int32_t mask = SENSORS_RING_CAPACITY - 1;
+    int n = 0;
+
+    for (;;) {
+        int32_t head = r->header->head;
+        __sync_synchronize();
+
+        if ((uint32_t)(head - r->cursor) > SENSORS_RING_CAPACITY) {
+            r->lost += (head - r->cursor) - SENSORS_RING_CAPACITY;
+            r->cursor = head - SENSORS_RING_CAPACITY;
+        }
+
+        while (n < count && r->cursor != head) {
+            const struct sensors_ring_slot* slot = &r->slots[r->cursor & mask];
+            int32_t seq = slot->seq;
+            __sync_synchronize();
+            if (seq == r->cursor) {
+                data[n] = slot->event;
+                __sync_synchronize();
+                if (slot->seq != seq)
+                    seq = ~seq;
+            }
+            if (seq != r->cursor) {
+                /* overwritten under our feet */
+                r->lost++;
+                r->cursor++;
+                continue;
+            }
+            r->cursor++;
+
+            int handle = data[n].sensor;
+            if (handle >= 0 && handle < SENSORS_RING_MAX_HANDLES &&
+                    r->decimation[handle] > 1) {
+                if (r->count[handle]++ % r->decimation[handle])
+                    continue;
+            }
+            n++;
+        }
+
+        if (n || !timeout_ms)
+            return n;
+
+        struct timespec ts;
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (timeout_ms % 1000) * 1000000;
+        if (syscall(__NR_futex, &r->header->head, FUTEX_WAIT, head,
+                timeout_ms < 0 ? NULL : &ts, NULL, 0) < 0 &&
+                errno == ETIMEDOUT) {
+            return 0;
+        }
+    }
+}
+
+__END_DECLS
+
+#endif /* ANDROID_INCLUDE_HARDWARE_SENSORS_RING_H */
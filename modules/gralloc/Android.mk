@@ -15,6 +15,14 @@
 
 LOCAL_PATH := $(call my-dir)
 
+gralloc_src_files := 	\
+	gralloc.cpp 	\
+	framebuffer.cpp \
+	mapper.cpp \
+	pool.cpp \
+	hugepage.cpp \
+	blit.cpp
+
 # HAL module implemenation stored in
 # hw/<OVERLAY_HARDWARE_MODULE_ID>.<ro.product.board>.so
 include $(CLEAR_VARS)
@@ -22,12 +30,35 @@ include $(CLEAR_VARS)
 LOCAL_MODULE_PATH := $(TARGET_OUT_SHARED_LIBRARIES)/hw
 LOCAL_SHARED_LIBRARIES := liblog libcutils
 
-LOCAL_SRC_FILES := 	\
-	gralloc.cpp 	\
-	framebuffer.cpp \
-	mapper.cpp
+LOCAL_SRC_FILES := $(gralloc_src_files) backend.cpp
 	
 LOCAL_MODULE := gralloc.default
 LOCAL_CFLAGS:= -DLOG_TAG=\"gralloc\"
+ifneq ($(NUM_FRAMEBUFFER_SURFACE_BUFFERS),)
+LOCAL_CFLAGS += -DNUM_BUFFERS=$(NUM_FRAMEBUFFER_SURFACE_BUFFERS)
+endif
+ifeq ($(ARCH_ARM_HAVE_NEON),true)
+LOCAL_ARM_NEON := true
+endif
+# the panel refreshes itself and takes the update rect from FBIOPUT_VSCREENINFO
+ifeq ($(BOARD_FB_PARTIAL_UPDATE),true)
+LOCAL_CFLAGS += -DFB_PARTIAL_UPDATE
+endif
 
 include $(BUILD_SHARED_LIBRARY)
+
+# the same module for the build host, on memfd and an emulated framebuffer.
+# It provides hw_get_module() as well, the host benchmarks link it
+# statically in place of libhardware. It needs <linux/fb.h>, memfd and
+# eventfd, so only Linux hosts build it.
+ifeq ($(HOST_OS),linux)
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := $(gralloc_src_files) backend_host.cpp
+
+LOCAL_MODULE := libgralloc_host
+LOCAL_MODULE_TAGS := optional
+LOCAL_CFLAGS:= -DLOG_TAG=\"gralloc\"
+
+include $(BUILD_HOST_STATIC_LIBRARY)
+endif # HOST_OS == linux
@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <linux/ashmem.h>
+
+#include <cutils/ashmem.h>
+#include <cutils/log.h>
+
+#include "gralloc_priv.h"
+#include "gr.h"
+
+/*****************************************************************************/
+
+/*
+ * What the module runs on: ashmem for the buffers and the fbdev driver for
+ * the display. backend_host.cpp replaces it on the build host.
+ *
+ * All ashmem regions share the inode of /dev/ashmem, so each buffer is
+ * named after a random nonce instead. Any process holding the fd can
+ * rename or resize a region until it is first mapped, so the region is
+ * mapped once as soon as it's created, which fixes both for good, whether
+ * or not the allocator maps it for the CPU later.
+ */
+
+#define REGION_NAME_PREFIX  "gralloc-buffer-"
+
+static pthread_once_t sRandomOnce = PTHREAD_ONCE_INIT;
+static int sRandomFd = -1;
+
+static void openRandom()
+{
+    sRandomFd = open("/dev/urandom", O_RDONLY);
+    LOGE_IF(sRandomFd<0, "couldn't open /dev/urandom (%s)", strerror(errno));
+}
+
+static int newNonce(uint64_t* nonce)
+{
+    pthread_once(&sRandomOnce, openRandom);
+    if (sRandomFd < 0)
+        return -ENODEV;
+    if (read(sRandomFd, nonce, sizeof(*nonce)) != sizeof(*nonce))
+        return -errno;
+    return 0;
+}
+
+int createBufferRegion(size_t size)
+{
+    uint64_t nonce;
+    int err = newNonce(&nonce);
+    if (err < 0)
+        return err;
+    char name[ASHMEM_NAME_LEN];
+    snprintf(name, sizeof(name), REGION_NAME_PREFIX "%016llx",
+            (unsigned long long)nonce);
+    int fd = ashmem_create_region(name, size);
+    if (fd < 0) {
+        LOGE("couldn't create ashmem (%s)", strerror(errno));
+        return -errno;
+    }
+    void* base = mmap(0, size, PROT_NONE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        err = -errno;
+        LOGE("couldn't map ashmem (%s)", strerror(errno));
+        close(fd);
+        return err;
+    }
+    munmap(base, size);
+    return fd;
+}
+
+int getBufferRegionKey(int fd, region_key_t* key)
+{
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+        return -errno;
+    memset(key, 0, sizeof(*key));
+    if (!S_ISCHR(st.st_mode)) {
+        // a huge page buffer, memfds have inodes of their own
+        key->dev = st.st_dev;
+        key->ino = st.st_ino;
+        return 0;
+    }
+
+    char name[ASHMEM_NAME_LEN];
+    if (ioctl(fd, ASHMEM_GET_NAME, name) < 0)
+        return -errno;
+    name[ASHMEM_NAME_LEN-1] = 0;
+    const size_t prefix = sizeof(REGION_NAME_PREFIX) - 1;
+    char* end;
+    if (strncmp(name, REGION_NAME_PREFIX, prefix))
+        return -EINVAL;
+    key->nonce = strtoull(name + prefix, &end, 16);
+    if (end == name + prefix || *end)
+        return -EINVAL;
+    return 0;
+}
+
+int openFramebufferDevice()
+{
+    char const * const device_template[] = {
+            "/dev/graphics/fb%u",
+            "/dev/fb%u",
+            0 };
+
+    int fd = -1;
+    int i=0;
+    char name[64];
+
+    while ((fd==-1) && device_template[i]) {
+        snprintf(name, 64, device_template[i], 0);
+        fd = open(name, O_RDWR, 0);
+        i++;
+    }
+    if (fd < 0)
+        return -errno;
+    return fd;
+}
+
+int framebufferIoctl(int fd, int request, void* arg)
+{
+    return ioctl(fd, request, arg);
+}
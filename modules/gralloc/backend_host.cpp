@@ -0,0 +1,245 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include <cutils/log.h>
+
+#include <hardware/hardware.h>
+#include <hardware/gralloc.h>
+
+#include "gralloc_priv.h"
+#include "gr.h"
+
+/*****************************************************************************/
+
+/*
+ * The backend of the build host, where there is neither ashmem nor a
+ * framebuffer, so that the module and the benchmarks can run on a plain
+ * Linux machine:
+ *
+ * Buffers are memfds, told apart by their inodes.
+ *
+ * The framebuffer is emulated, GRALLOC_HOST_FB=<width>x<height>[x<bpp>]
+ * sets its mode (720x1280x32 by default). Its memory is a memfd, or the
+ * file GRALLOC_HOST_FB_FILE names so that what was posted can be looked
+ * at. It holds HOST_FB_SCREENS screens, and refreshes at 60 Hz: a pan with
+ * FB_ACTIVATE_VBL and FBIO_WAITFORVSYNC return at the next refresh.
+ *
+ * This file also stands in for libhardware, hw_get_module() returns this
+ * module.
+ */
+
+#define HOST_FB_SCREENS     4
+#define HOST_FB_PERIOD      (1000000000LL / 60)
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC         0x0001U
+#endif
+
+struct host_fb_t {
+    int fd;
+    struct fb_var_screeninfo info;
+    struct fb_fix_screeninfo finfo;
+};
+
+static pthread_mutex_t sFbLock = PTHREAD_MUTEX_INITIALIZER;
+static host_fb_t sFb = { -1 };
+
+static int memfdCreate(const char* name)
+{
+#ifdef __NR_memfd_create
+    return syscall(__NR_memfd_create, name, MFD_CLOEXEC);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+static int64_t hostNow()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return int64_t(t.tv_sec)*1000000000LL + t.tv_nsec;
+}
+
+/* sleeps until the next refresh of the emulated display */
+static void waitForVsync()
+{
+    const int64_t now = hostNow();
+    const int64_t next = (now / HOST_FB_PERIOD + 1) * HOST_FB_PERIOD;
+    struct timespec ts;
+    ts.tv_sec = next / 1000000000LL;
+    ts.tv_nsec = next % 1000000000LL;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+}
+
+/*****************************************************************************/
+
+int createBufferRegion(size_t size)
+{
+    int fd = memfdCreate("gralloc-buffer");
+    if (fd < 0 || ftruncate(fd, size) < 0) {
+        int err = -errno;
+        LOGE("couldn't create memfd (%s)", strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return err;
+    }
+    return fd;
+}
+
+int getBufferRegionKey(int fd, region_key_t* key)
+{
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+        return -errno;
+    memset(key, 0, sizeof(*key));
+    key->dev = st.st_dev;
+    key->ino = st.st_ino;
+    return 0;
+}
+
+int openFramebufferDevice()
+{
+    pthread_mutex_lock(&sFbLock);
+    if (sFb.fd < 0) {
+        int w = 720, h = 1280, bpp = 32;
+        const char* mode = getenv("GRALLOC_HOST_FB");
+        if (mode && sscanf(mode, "%dx%dx%d", &w, &h, &bpp) < 2) {
+            LOGW("GRALLOC_HOST_FB=%s isn't <width>x<height>[x<bpp>]", mode);
+        }
+        if (w <= 0 || h <= 0 || (bpp != 16 && bpp != 32)) {
+            pthread_mutex_unlock(&sFbLock);
+            return -EINVAL;
+        }
+
+        host_fb_t fb;
+        memset(&fb, 0, sizeof(fb));
+        strcpy(fb.finfo.id, "host");
+        fb.finfo.line_length = (w * (bpp >> 3) + 63) & ~63;
+        fb.finfo.smem_len = fb.finfo.line_length * h * HOST_FB_SCREENS;
+        fb.finfo.type = FB_TYPE_PACKED_PIXELS;
+        fb.finfo.visual = FB_VISUAL_TRUECOLOR;
+        fb.info.xres = fb.info.xres_virtual = w;
+        fb.info.yres = fb.info.yres_virtual = h;
+        fb.info.bits_per_pixel = bpp;
+        if (bpp == 16) {
+            fb.info.red.offset = 11;    fb.info.red.length = 5;
+            fb.info.green.offset = 5;   fb.info.green.length = 6;
+            fb.info.blue.offset = 0;    fb.info.blue.length = 5;
+        } else {
+            // RGBX_8888
+            fb.info.red.offset = 0;     fb.info.red.length = 8;
+            fb.info.green.offset = 8;   fb.info.green.length = 8;
+            fb.info.blue.offset = 16;   fb.info.blue.length = 8;
+        }
+        // a pixclock of 0 lets the module assume 60 Hz and 160 dpi
+
+        const char* path = getenv("GRALLOC_HOST_FB_FILE");
+        fb.fd = path ? open(path, O_RDWR|O_CREAT|O_CLOEXEC, 0644)
+                     : memfdCreate("gralloc-fb");
+        if (fb.fd < 0 || ftruncate(fb.fd, fb.finfo.smem_len) < 0) {
+            int err = -errno;
+            LOGE("couldn't create the host framebuffer (%s)", strerror(errno));
+            if (fb.fd >= 0)
+                close(fb.fd);
+            pthread_mutex_unlock(&sFbLock);
+            return err;
+        }
+        sFb = fb;
+    }
+    // the module keeps its own dup() of the device
+    int fd = dup(sFb.fd);
+    pthread_mutex_unlock(&sFbLock);
+    return (fd < 0) ? -errno : fd;
+}
+
+/* there's only one framebuffer, whatever the fd */
+int framebufferIoctl(int fd, int request, void* arg)
+{
+    int err = 0;
+    bool vsync = false;
+    pthread_mutex_lock(&sFbLock);
+    switch (request) {
+        case FBIOGET_FSCREENINFO:
+            memcpy(arg, &sFb.finfo, sizeof(sFb.finfo));
+            break;
+        case FBIOGET_VSCREENINFO:
+            memcpy(arg, &sFb.info, sizeof(sFb.info));
+            break;
+        case FBIOPUT_VSCREENINFO: {
+            // only the virtual height and the panning can change
+            const struct fb_var_screeninfo* info =
+                    (const struct fb_var_screeninfo*)arg;
+            if (info->xres != sFb.info.xres || info->yres != sFb.info.yres ||
+                    info->bits_per_pixel != sFb.info.bits_per_pixel ||
+                    info->yres_virtual < info->yres ||
+                    info->yres_virtual * sFb.finfo.line_length >
+                            sFb.finfo.smem_len ||
+                    info->yoffset + info->yres > info->yres_virtual) {
+                err = EINVAL;
+                break;
+            }
+            sFb.info.yres_virtual = info->yres_virtual;
+            sFb.info.yoffset = info->yoffset;
+            vsync = (info->activate & FB_ACTIVATE_VBL) != 0;
+            break;
+        }
+#ifdef FBIO_WAITFORVSYNC
+        case FBIO_WAITFORVSYNC:
+            vsync = true;
+            break;
+#endif
+        default:
+            err = ENOTTY;
+            break;
+    }
+    pthread_mutex_unlock(&sFbLock);
+
+    if (err) {
+        errno = err;
+        return -1;
+    }
+    if (vsync) {
+        waitForVsync();
+    }
+    return 0;
+}
+
+/*****************************************************************************/
+
+extern struct private_module_t HAL_MODULE_INFO_SYM;
+
+int hw_get_module(const char* id, const struct hw_module_t** module)
+{
+    if (strcmp(id, GRALLOC_HARDWARE_MODULE_ID))
+        return -ENOENT;
+    *module = &HAL_MODULE_INFO_SYM.base.common;
+    return 0;
+}
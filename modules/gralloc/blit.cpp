@@ -0,0 +1,416 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "blit.h"
+
+/*****************************************************************************/
+
+/*
+ * A row kernel converts <n> pixels, or copies <n> bytes for the plain
+ * copy. The source and destination have no alignment guarantee.
+ */
+typedef void (*blit_row_t)(void* dst, const void* src, size_t n);
+
+/*
+ * 8888 formats are stored R,G,B,A (or B,G,R,A) in memory, that is with R
+ * (or B) in the low byte of a little-endian word.
+ */
+
+static void copy_c(void* dst, const void* src, size_t n)
+{
+    memcpy(dst, src, n);
+}
+
+static void rgba_to_565_c(void* dst, const void* src, size_t n)
+{
+    uint16_t* d = (uint16_t*)dst;
+    const uint32_t* s = (const uint32_t*)src;
+    for (size_t i=0 ; i<n ; i++) {
+        const uint32_t p = s[i];
+        d[i] = ((p << 8) & 0xF800) | ((p >> 5) & 0x07E0) | ((p >> 19) & 0x001F);
+    }
+}
+
+static void bgra_to_565_c(void* dst, const void* src, size_t n)
+{
+    uint16_t* d = (uint16_t*)dst;
+    const uint32_t* s = (const uint32_t*)src;
+    for (size_t i=0 ; i<n ; i++) {
+        const uint32_t p = s[i];
+        d[i] = ((p >> 8) & 0xF800) | ((p >> 5) & 0x07E0) | ((p >> 3) & 0x001F);
+    }
+}
+
+/* RGBA <-> BGRA, swaps the low and the third byte */
+static void swap_rb_c(void* dst, const void* src, size_t n)
+{
+    uint32_t* d = (uint32_t*)dst;
+    const uint32_t* s = (const uint32_t*)src;
+    for (size_t i=0 ; i<n ; i++) {
+        const uint32_t p = s[i];
+        d[i] = (p & 0xFF00FF00) | ((p >> 16) & 0xFF) | ((p & 0xFF) << 16);
+    }
+}
+
+static void rgb565_to_rgba_c(void* dst, const void* src, size_t n)
+{
+    uint32_t* d = (uint32_t*)dst;
+    const uint16_t* s = (const uint16_t*)src;
+    for (size_t i=0 ; i<n ; i++) {
+        const uint32_t v = s[i];
+        const uint32_t r = v >> 11;
+        const uint32_t g = (v >> 5) & 0x3F;
+        const uint32_t b = v & 0x1F;
+        d[i] = 0xFF000000 |
+                (((b << 3) | (b >> 2)) << 16) |
+                (((g << 2) | (g >> 4)) << 8) |
+                ((r << 3) | (r >> 2));
+    }
+}
+
+/*****************************************************************************/
+
+#if defined(__ARM_NEON__)
+
+/*
+ * NEON has no non-temporal stores, but full 64-byte bursts already suit
+ * write-combined memory, so BLIT_NONTEMPORAL uses the same kernels.
+ */
+
+static void copy_neon(void* dst, const void* src, size_t n)
+{
+    uint8_t* d = (uint8_t*)dst;
+    const uint8_t* s = (const uint8_t*)src;
+    for ( ; n >= 64 ; n -= 64, d += 64, s += 64) {
+        __builtin_prefetch(s + 256);
+        uint8x16_t a = vld1q_u8(s);
+        uint8x16_t b = vld1q_u8(s + 16);
+        uint8x16_t c = vld1q_u8(s + 32);
+        uint8x16_t e = vld1q_u8(s + 48);
+        vst1q_u8(d, a);
+        vst1q_u8(d + 16, b);
+        vst1q_u8(d + 32, c);
+        vst1q_u8(d + 48, e);
+    }
+    memcpy(d, s, n);
+}
+
+static inline uint16x8_t pack565_neon(uint8x8_t r, uint8x8_t g, uint8x8_t b)
+{
+    uint16x8_t v = vshll_n_u8(r, 8);
+    v = vsriq_n_u16(v, vshll_n_u8(g, 8), 5);
+    v = vsriq_n_u16(v, vshll_n_u8(b, 8), 11);
+    return v;
+}
+
+static void rgba_to_565_neon(void* dst, const void* src, size_t n)
+{
+    uint16_t* d = (uint16_t*)dst;
+    const uint8_t* s = (const uint8_t*)src;
+    for ( ; n >= 8 ; n -= 8, d += 8, s += 32) {
+        uint8x8x4_t p = vld4_u8(s);
+        vst1q_u16(d, pack565_neon(p.val[0], p.val[1], p.val[2]));
+    }
+    rgba_to_565_c(d, s, n);
+}
+
+static void bgra_to_565_neon(void* dst, const void* src, size_t n)
+{
+    uint16_t* d = (uint16_t*)dst;
+    const uint8_t* s = (const uint8_t*)src;
+    for ( ; n >= 8 ; n -= 8, d += 8, s += 32) {
+        uint8x8x4_t p = vld4_u8(s);
+        vst1q_u16(d, pack565_neon(p.val[2], p.val[1], p.val[0]));
+    }
+    bgra_to_565_c(d, s, n);
+}
+
+static void swap_rb_neon(void* dst, const void* src, size_t n)
+{
+    uint8_t* d = (uint8_t*)dst;
+    const uint8_t* s = (const uint8_t*)src;
+    for ( ; n >= 16 ; n -= 16, d += 64, s += 64) {
+        uint8x16x4_t p = vld4q_u8(s);
+        uint8x16_t r = p.val[0];
+        p.val[0] = p.val[2];
+        p.val[2] = r;
+        vst4q_u8(d, p);
+    }
+    swap_rb_c(d, s, n);
+}
+
+static void rgb565_to_rgba_neon(void* dst, const void* src, size_t n)
+{
+    uint8_t* d = (uint8_t*)dst;
+    const uint16_t* s = (const uint16_t*)src;
+    for ( ; n >= 8 ; n -= 8, d += 32, s += 8) {
+        uint16x8_t v = vld1q_u16(s);
+        uint8x8_t r = vshrn_n_u16(v, 8);
+        uint8x8_t g = vshrn_n_u16(v, 3);
+        uint8x8_t b = vmovn_u16(vshlq_n_u16(v, 3));
+        uint8x8x4_t p;
+        // replicate the top bits into the ones the shift cleared
+        p.val[0] = vsri_n_u8(r, r, 5);
+        p.val[1] = vsri_n_u8(g, g, 6);
+        p.val[2] = vsri_n_u8(b, b, 5);
+        p.val[3] = vdup_n_u8(0xFF);
+        vst4_u8(d, p);
+    }
+    rgb565_to_rgba_c(d, s, n);
+}
+
+#endif // __ARM_NEON__
+
+/*****************************************************************************/
+
+#if defined(__SSE2__)
+
+/*
+ * The SSE2 kernels process the unaligned head of the destination with the
+ * C kernel, so that the main loop can use aligned, and possibly
+ * non-temporal, stores.
+ */
+
+template <bool NT>
+static inline void store128(void* d, __m128i v)
+{
+    if (NT)
+        _mm_stream_si128((__m128i*)d, v);
+    else
+        _mm_store_si128((__m128i*)d, v);
+}
+
+/* number of <bpp> pixels before <d> is 16-byte aligned, or n if it never is */
+static inline size_t alignHead(const void* d, size_t bpp, size_t n)
+{
+    const size_t misalign = (16 - (uintptr_t(d) & 15)) & 15;
+    if (misalign % bpp)
+        return n;
+    const size_t head = misalign / bpp;
+    return (head < n) ? head : n;
+}
+
+template <bool NT>
+static void copy_sse2(void* dst, const void* src, size_t n)
+{
+    uint8_t* d = (uint8_t*)dst;
+    const uint8_t* s = (const uint8_t*)src;
+    const size_t head = alignHead(d, 1, n);
+    memcpy(d, s, head);
+    d += head;
+    s += head;
+    n -= head;
+    for ( ; n >= 64 ; n -= 64, d += 64, s += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i*)s);
+        __m128i b = _mm_loadu_si128((const __m128i*)(s + 16));
+        __m128i c = _mm_loadu_si128((const __m128i*)(s + 32));
+        __m128i e = _mm_loadu_si128((const __m128i*)(s + 48));
+        store128<NT>(d, a);
+        store128<NT>(d + 16, b);
+        store128<NT>(d + 32, c);
+        store128<NT>(d + 48, e);
+    }
+    for ( ; n >= 16 ; n -= 16, d += 16, s += 16) {
+        store128<NT>(d, _mm_loadu_si128((const __m128i*)s));
+    }
+    memcpy(d, s, n);
+}
+
+/* 4 RGBA (or BGRA when <bgr>) pixels to 565, in the low half of each lane */
+static inline __m128i pack565_sse2(__m128i p, bool bgr)
+{
+    const __m128i r = bgr ?
+            _mm_and_si128(_mm_srli_epi32(p, 8), _mm_set1_epi32(0xF800)) :
+            _mm_and_si128(_mm_slli_epi32(p, 8), _mm_set1_epi32(0xF800));
+    const __m128i g = _mm_and_si128(_mm_srli_epi32(p, 5), _mm_set1_epi32(0x07E0));
+    const __m128i b = bgr ?
+            _mm_and_si128(_mm_srli_epi32(p, 3), _mm_set1_epi32(0x001F)) :
+            _mm_and_si128(_mm_srli_epi32(p, 19), _mm_set1_epi32(0x001F));
+    const __m128i v = _mm_or_si128(_mm_or_si128(r, g), b);
+    // sign-extend, so that the saturating pack keeps the 16 bits as they are
+    return _mm_srai_epi32(_mm_slli_epi32(v, 16), 16);
+}
+
+template <bool NT, bool BGR>
+static void to565_sse2(void* dst, const void* src, size_t n)
+{
+    const blit_row_t c = BGR ? bgra_to_565_c : rgba_to_565_c;
+    uint16_t* d = (uint16_t*)dst;
+    const uint32_t* s = (const uint32_t*)src;
+    const size_t head = alignHead(d, 2, n);
+    c(d, s, head);
+    d += head;
+    s += head;
+    n -= head;
+    for ( ; n >= 8 ; n -= 8, d += 8, s += 8) {
+        __m128i a = pack565_sse2(_mm_loadu_si128((const __m128i*)s), BGR);
+        __m128i b = pack565_sse2(_mm_loadu_si128((const __m128i*)(s + 4)), BGR);
+        store128<NT>(d, _mm_packs_epi32(a, b));
+    }
+    c(d, s, n);
+}
+
+template <bool NT>
+static void swap_rb_sse2(void* dst, const void* src, size_t n)
+{
+    uint32_t* d = (uint32_t*)dst;
+    const uint32_t* s = (const uint32_t*)src;
+    const size_t head = alignHead(d, 4, n);
+    swap_rb_c(d, s, head);
+    d += head;
+    s += head;
+    n -= head;
+    const __m128i ga = _mm_set1_epi32(0xFF00FF00);
+    const __m128i lo = _mm_set1_epi32(0x000000FF);
+    for ( ; n >= 4 ; n -= 4, d += 4, s += 4) {
+        const __m128i p = _mm_loadu_si128((const __m128i*)s);
+        __m128i v = _mm_and_si128(p, ga);
+        v = _mm_or_si128(v, _mm_and_si128(_mm_srli_epi32(p, 16), lo));
+        v = _mm_or_si128(v, _mm_slli_epi32(_mm_and_si128(p, lo), 16));
+        store128<NT>(d, v);
+    }
+    swap_rb_c(d, s, n);
+}
+
+#endif // __SSE2__
+
+/*****************************************************************************/
+
+enum {
+    // the kernel takes a count of bytes instead of pixels
+    KERNEL_BYTES = 0x1
+};
+
+struct blit_kernel_t {
+    int         dst;
+    int         src;
+    int         flags;
+    blit_row_t  c;
+    blit_row_t  simd;
+    blit_row_t  simd_nt;
+};
+
+#if defined(__ARM_NEON__)
+#define SIMD(neon, sse2, sse2_nt)   neon, neon
+#elif defined(__SSE2__)
+#define SIMD(neon, sse2, sse2_nt)   sse2, sse2_nt
+#else
+#define SIMD(neon, sse2, sse2_nt)   0, 0
+#endif
+
+/* a dst format of 0 matches the src format, for plain copies */
+static const blit_kernel_t sKernels[] = {
+    { 0, 0, KERNEL_BYTES, copy_c,
+            SIMD(copy_neon, copy_sse2<false>, copy_sse2<true>) },
+    { HAL_PIXEL_FORMAT_RGBX_8888, HAL_PIXEL_FORMAT_RGBA_8888, KERNEL_BYTES, copy_c,
+            SIMD(copy_neon, copy_sse2<false>, copy_sse2<true>) },
+    { HAL_PIXEL_FORMAT_RGB_565, HAL_PIXEL_FORMAT_RGBA_8888, 0, rgba_to_565_c,
+            SIMD(rgba_to_565_neon, (to565_sse2<false, false>), (to565_sse2<true, false>)) },
+    { HAL_PIXEL_FORMAT_RGB_565, HAL_PIXEL_FORMAT_RGBX_8888, 0, rgba_to_565_c,
+            SIMD(rgba_to_565_neon, (to565_sse2<false, false>), (to565_sse2<true, false>)) },
+    { HAL_PIXEL_FORMAT_RGB_565, HAL_PIXEL_FORMAT_BGRA_8888, 0, bgra_to_565_c,
+            SIMD(bgra_to_565_neon, (to565_sse2<false, true>), (to565_sse2<true, true>)) },
+    { HAL_PIXEL_FORMAT_BGRA_8888, HAL_PIXEL_FORMAT_RGBA_8888, 0, swap_rb_c,
+            SIMD(swap_rb_neon, swap_rb_sse2<false>, swap_rb_sse2<true>) },
+    { HAL_PIXEL_FORMAT_BGRA_8888, HAL_PIXEL_FORMAT_RGBX_8888, 0, swap_rb_c,
+            SIMD(swap_rb_neon, swap_rb_sse2<false>, swap_rb_sse2<true>) },
+    { HAL_PIXEL_FORMAT_RGBA_8888, HAL_PIXEL_FORMAT_BGRA_8888, 0, swap_rb_c,
+            SIMD(swap_rb_neon, swap_rb_sse2<false>, swap_rb_sse2<true>) },
+    { HAL_PIXEL_FORMAT_RGBX_8888, HAL_PIXEL_FORMAT_BGRA_8888, 0, swap_rb_c,
+            SIMD(swap_rb_neon, swap_rb_sse2<false>, swap_rb_sse2<true>) },
+    { HAL_PIXEL_FORMAT_RGBA_8888, HAL_PIXEL_FORMAT_RGB_565, 0, rgb565_to_rgba_c,
+            SIMD(rgb565_to_rgba_neon, 0, 0) },
+    { HAL_PIXEL_FORMAT_RGBX_8888, HAL_PIXEL_FORMAT_RGB_565, 0, rgb565_to_rgba_c,
+            SIMD(rgb565_to_rgba_neon, 0, 0) },
+};
+
+static const blit_kernel_t* findKernel(int dst, int src)
+{
+    if (dst == src)
+        return &sKernels[0];
+    for (size_t i=1 ; i<sizeof(sKernels)/sizeof(*sKernels) ; i++) {
+        if (sKernels[i].dst == dst && sKernels[i].src == src)
+            return &sKernels[i];
+    }
+    return NULL;
+}
+
+/*****************************************************************************/
+
+int blitBytesPerPixel(int format)
+{
+    switch (format) {
+        case HAL_PIXEL_FORMAT_RGBA_8888:
+        case HAL_PIXEL_FORMAT_RGBX_8888:
+        case HAL_PIXEL_FORMAT_BGRA_8888:
+            return 4;
+        case HAL_PIXEL_FORMAT_RGB_888:
+            return 3;
+        case HAL_PIXEL_FORMAT_RGB_565:
+        case HAL_PIXEL_FORMAT_RGBA_5551:
+        case HAL_PIXEL_FORMAT_RGBA_4444:
+            return 2;
+    }
+    return 0;
+}
+
+int blitRect(const blit_buffer_t* dst, const blit_buffer_t* src,
+        uint32_t l, uint32_t t, uint32_t w, uint32_t h, int flags)
+{
+    const size_t dbpp = blitBytesPerPixel(dst->format);
+    const size_t sbpp = blitBytesPerPixel(src->format);
+    const blit_kernel_t* k = findKernel(dst->format, src->format);
+    if (!dbpp || !sbpp || !k)
+        return -EINVAL;
+
+    blit_row_t row = k->c;
+    if (!(flags & BLIT_NO_SIMD) && k->simd) {
+        row = (flags & BLIT_NONTEMPORAL) ? k->simd_nt : k->simd;
+    }
+
+    uint8_t* d = (uint8_t*)dst->base + t*dst->bpr + l*dbpp;
+    const uint8_t* s = (const uint8_t*)src->base + t*src->bpr + l*sbpp;
+    const size_t n = (k->flags & KERNEL_BYTES) ? w*sbpp : w;
+
+    if ((k->flags & KERNEL_BYTES) && dst->bpr == n && src->bpr == n) {
+        // contiguous rows, a single copy
+        row(d, s, n*h);
+    } else {
+        for (uint32_t y=0 ; y<h ; y++) {
+            row(d, s, n);
+            d += dst->bpr;
+            s += src->bpr;
+        }
+    }
+
+#if defined(__SSE2__)
+    if (flags & BLIT_NONTEMPORAL)
+        _mm_sfence();
+#endif
+    return 0;
+}
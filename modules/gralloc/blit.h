@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef GRALLOC_BLIT_H_
+#define GRALLOC_BLIT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/cdefs.h>
+
+#include <system/graphics.h>
+
+/*****************************************************************************/
+
+/*
+ * Software blitter used by fb_post() when it can't flip. It copies a
+ * rectangle between buffers whose rows have a different pitch, converting
+ * the pixel format in the same pass. The row kernels use NEON or SSE2
+ * when the compiler targets them, and plain C otherwise.
+ *
+ * Supported conversions:
+ *      any format to itself
+ *      RGBA_8888, RGBX_8888, BGRA_8888 -> RGB_565
+ *      RGBA_8888, RGBX_8888 <-> BGRA_8888
+ *      RGB_565 -> RGBA_8888, RGBX_8888
+ */
+
+enum {
+    /*
+     * Bypass the cache when writing the destination. Faster for
+     * write-combined memory such as the framebuffer, which is never read
+     * back by the CPU.
+     */
+    BLIT_NONTEMPORAL    = 0x00000001,
+    /* use the C kernels only */
+    BLIT_NO_SIMD        = 0x00000002
+};
+
+struct blit_buffer_t {
+    void*   base;
+    /* bytes between the start of two rows */
+    size_t  bpr;
+    int     format;
+};
+
+/* bytes per pixel of the formats the blitter handles, 0 otherwise */
+int blitBytesPerPixel(int format);
+
+/*
+ * Copies the w x h rectangle at l,t of <src> to the same place in <dst>.
+ * Returns -EINVAL if the conversion isn't supported.
+ */
+int blitRect(const blit_buffer_t* dst, const blit_buffer_t* src,
+        uint32_t l, uint32_t t, uint32_t w, uint32_t h, int flags);
+
+/*****************************************************************************/
+
+#endif /* GRALLOC_BLIT_H_ */
@@ -15,6 +15,7 @@
  */
 
 #include <sys/mman.h>
+#include <sys/eventfd.h>
 
 #include <dlfcn.h>
 
@@ -26,12 +27,15 @@
 
 #include <fcntl.h>
 #include <errno.h>
+#include <pthread.h>
 #include <sys/ioctl.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include <cutils/log.h>
 #include <cutils/atomic.h>
+#include <cutils/properties.h>
 
 #if HAVE_ANDROID_OS
 #include <linux/fb.h>
@@ -39,31 +43,117 @@
 
 #include "gralloc_priv.h"
 #include "gr.h"
+#include "blit.h"
 
 /*****************************************************************************/
 
-// numbers of buffers for page flipping
-#define NUM_BUFFERS 2
+// maximum numbers of buffers for page flipping, the board can override it
+// with NUM_FRAMEBUFFER_SURFACE_BUFFERS and debug.gralloc.num_buffers
+#ifndef NUM_BUFFERS
+#define NUM_BUFFERS 3
+#endif
+
+// longest swap interval, in refresh periods
+#define MAX_SWAP_INTERVAL 4
+
+// flips fb_postAsync() can have pending, including the one in progress
+#define FLIP_QUEUE_SIZE 2
 
+// fb_var_screeninfo.reserved[0] when reserved[1..2] hold an update rect
+#define UPDATE_RECT_MAGIC 0x54445055 // "UPDT"
 
 enum {
     PAGE_FLIP = 0x00000001,
     LOCKED = 0x00000002
 };
 
+struct flip_t {
+    buffer_handle_t buffer;
+    // the screen info to pan with and the swap interval, taken when the
+    // flip was queued
+    struct fb_var_screeninfo info;
+    int swapInterval;
+    // written to once the flip is done
+    int releaseFd;
+};
+
 struct fb_context_t {
     framebuffer_device_t  device;
+
+    // guards the state below, which the flip thread shares with callers
+    pthread_mutex_t flipLock;
+    int swapInterval;
+    // when the last post completed, for swap intervals >= 2
+    int64_t lastPost;
+    // cleared if the driver doesn't implement FBIO_WAITFORVSYNC
+    bool waitForVsync;
+
+    // the flip thread, started by the first fb_postAsync()
+    pthread_t flipThread;
+    bool flipThreadStarted;
+    bool exiting;
+    pthread_cond_t flipCond;
+    flip_t flips[FLIP_QUEUE_SIZE];
+    int flipHead;
+    int flipCount;
 };
 
 /*****************************************************************************/
 
+static int64_t fb_now()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return int64_t(t.tv_sec)*1000000000LL + t.tv_nsec;
+}
+
+/*
+ * Waits until swapInterval-1 refresh periods have elapsed since the last
+ * post; the flip itself waits for the last vsync. Works on copies of the
+ * context's state, taken under flipLock.
+ */
+static void fb_pace(private_module_t* m, int swapInterval, int64_t lastPost,
+        bool* waitForVsync)
+{
+    const int64_t period = int64_t(1000000000.0f / m->fps);
+    const int64_t target = lastPost + (swapInterval - 1) * period;
+    int64_t now = fb_now();
+    if (now >= target)
+        return;
+
+#ifdef FBIO_WAITFORVSYNC
+    while (*waitForVsync && now < target) {
+        uint32_t crtc = 0;
+        if (framebufferIoctl(m->framebuffer->fd,
+                FBIO_WAITFORVSYNC, &crtc) == -1) {
+            LOGW("FBIO_WAITFORVSYNC failed (%s), pacing with a timer",
+                    strerror(errno));
+            *waitForVsync = false;
+            break;
+        }
+        // don't wait for a vsync that is only a little early
+        now = fb_now() + period/4;
+    }
+#endif
+
+    if (now < target) {
+        struct timespec ts;
+        ts.tv_sec = target / 1000000000LL;
+        ts.tv_nsec = target % 1000000000LL;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+            ;
+    }
+}
+
 static int fb_setSwapInterval(struct framebuffer_device_t* dev,
             int interval)
 {
     fb_context_t* ctx = (fb_context_t*)dev;
     if (interval < dev->minSwapInterval || interval > dev->maxSwapInterval)
         return -EINVAL;
-    // FIXME: implement fb_setSwapInterval
+    pthread_mutex_lock(&ctx->flipLock);
+    ctx->swapInterval = interval;
+    pthread_mutex_unlock(&ctx->flipLock);
     return 0;
 }
 
@@ -76,12 +166,162 @@ static int fb_setUpdateRect(struct framebuffer_device_t* dev,
     fb_context_t* ctx = (fb_context_t*)dev;
     private_module_t* m = reinterpret_cast<private_module_t*>(
             dev->common.module);
-    m->info.reserved[0] = 0x54445055; // "UPDT";
+    m->info.reserved[0] = UPDATE_RECT_MAGIC;
     m->info.reserved[1] = (uint16_t)l | ((uint32_t)t << 16);
     m->info.reserved[2] = (uint16_t)(l+w) | ((uint32_t)(t+h) << 16);
     return 0;
 }
 
+/* the rectangle set for the next post, clipped to the screen */
+static void fb_getUpdateRect(private_module_t* m,
+        uint32_t* l, uint32_t* t, uint32_t* r, uint32_t* b)
+{
+    *l = 0;
+    *t = 0;
+    *r = m->info.xres;
+    *b = m->info.yres;
+    if (m->info.reserved[0] == UPDATE_RECT_MAGIC) {
+        *l = m->info.reserved[1] & 0xFFFF;
+        *t = m->info.reserved[1] >> 16;
+        if ((m->info.reserved[2] & 0xFFFF) < *r)
+            *r = m->info.reserved[2] & 0xFFFF;
+        if ((m->info.reserved[2] >> 16) < *b)
+            *b = m->info.reserved[2] >> 16;
+        if (*l > *r)
+            *l = *r;
+        if (*t > *b)
+            *t = *b;
+    }
+}
+
+/* the rectangle only applies to one post, the next one is a full update */
+static void fb_clearUpdateRect(private_module_t* m)
+{
+    m->info.reserved[0] = 0;
+    m->info.reserved[1] = 0;
+    m->info.reserved[2] = 0;
+}
+
+/*
+ * With fb_postAsync() the pans are done by a thread, which blocks until
+ * vsync in FBIOPUT_VSCREENINFO instead of the caller. Each queued flip
+ * carries its own copy of the screen info and swap interval so that the
+ * thread never touches m->info, and an eventfd it signals once the flip
+ * is done: the buffer that was shown before has then left scanout. What
+ * the flip changes is published under flipLock.
+ */
+
+static void* fb_flipThread(void* arg)
+{
+    fb_context_t* ctx = (fb_context_t*)arg;
+    private_module_t* m = reinterpret_cast<private_module_t*>(
+            ctx->device.common.module);
+
+    pthread_mutex_lock(&ctx->flipLock);
+    for (;;) {
+        while (!ctx->flipCount && !ctx->exiting)
+            pthread_cond_wait(&ctx->flipCond, &ctx->flipLock);
+        if (!ctx->flipCount)
+            break;
+        flip_t* flip = &ctx->flips[ctx->flipHead];
+        const int64_t lastPost = ctx->lastPost;
+        bool waitForVsync = ctx->waitForVsync;
+        pthread_mutex_unlock(&ctx->flipLock);
+
+        if (flip->swapInterval >= 2) {
+            fb_pace(m, flip->swapInterval, lastPost, &waitForVsync);
+        }
+        const bool flipped = framebufferIoctl(m->framebuffer->fd,
+                FBIOPUT_VSCREENINFO, &flip->info) != -1;
+        // the previous buffer is still shown if it failed, but nobody
+        // should wait for a flip that will never happen
+        LOGE_IF(!flipped, "FBIOPUT_VSCREENINFO failed (%s)", strerror(errno));
+        const int64_t done = fb_now();
+        const buffer_handle_t buffer = flip->buffer;
+        const int releaseFd = flip->releaseFd;
+
+        // the slot can be reused as soon as it's dequeued
+        pthread_mutex_lock(&ctx->flipLock);
+        if (flipped)
+            m->currentBuffer = buffer;
+        ctx->lastPost = done;
+        ctx->waitForVsync = waitForVsync;
+        ctx->flipHead = (ctx->flipHead + 1) % FLIP_QUEUE_SIZE;
+        ctx->flipCount--;
+        pthread_cond_broadcast(&ctx->flipCond);
+        pthread_mutex_unlock(&ctx->flipLock);
+
+        const uint64_t one = 1;
+        write(releaseFd, &one, sizeof(one));
+        close(releaseFd);
+
+        pthread_mutex_lock(&ctx->flipLock);
+    }
+    pthread_mutex_unlock(&ctx->flipLock);
+    return NULL;
+}
+
+static int fb_post(struct framebuffer_device_t* dev, buffer_handle_t buffer);
+
+static int fb_postAsync(struct framebuffer_device_t* dev,
+        buffer_handle_t buffer, int* releaseFd)
+{
+    if (private_handle_t::validate(buffer) < 0 || !releaseFd)
+        return -EINVAL;
+
+    *releaseFd = -1;
+    private_handle_t const* hnd = reinterpret_cast<private_handle_t const*>(buffer);
+    if (!(hnd->flags & private_handle_t::PRIV_FLAGS_FRAMEBUFFER)) {
+        // copied to the front buffer right away, nothing stays on screen
+        return fb_post(dev, buffer);
+    }
+
+    fb_context_t* ctx = (fb_context_t*)dev;
+    private_module_t* m = reinterpret_cast<private_module_t*>(
+            dev->common.module);
+
+    int fd = eventfd(0, EFD_CLOEXEC);
+    if (fd < 0)
+        return -errno;
+    // the thread closes its own copy once it has signaled it
+    int threadFd = dup(fd);
+    if (threadFd < 0) {
+        int err = -errno;
+        close(fd);
+        return err;
+    }
+
+    pthread_mutex_lock(&ctx->flipLock);
+    if (!ctx->flipThreadStarted) {
+        int err = pthread_create(&ctx->flipThread, NULL, fb_flipThread, ctx);
+        if (err) {
+            pthread_mutex_unlock(&ctx->flipLock);
+            close(threadFd);
+            close(fd);
+            return -err;
+        }
+        ctx->flipThreadStarted = true;
+    }
+    while (ctx->flipCount == FLIP_QUEUE_SIZE)
+        pthread_cond_wait(&ctx->flipCond, &ctx->flipLock);
+
+    flip_t* flip = &ctx->flips[(ctx->flipHead + ctx->flipCount) % FLIP_QUEUE_SIZE];
+    flip->buffer = buffer;
+    flip->releaseFd = threadFd;
+    flip->swapInterval = ctx->swapInterval;
+    flip->info = m->info;
+    // with a swap interval of 0 we flip right away, and may tear
+    flip->info.activate = flip->swapInterval ? FB_ACTIVATE_VBL : FB_ACTIVATE_NOW;
+    flip->info.yoffset = hnd->offset / m->finfo.line_length;
+    fb_clearUpdateRect(m);
+    ctx->flipCount++;
+    pthread_cond_broadcast(&ctx->flipCond);
+    pthread_mutex_unlock(&ctx->flipLock);
+
+    *releaseFd = fd;
+    return 0;
+}
+
 static int fb_post(struct framebuffer_device_t* dev, buffer_handle_t buffer)
 {
     if (private_handle_t::validate(buffer) < 0)
@@ -93,16 +333,34 @@ static int fb_post(struct framebuffer_device_t* dev, buffer_handle_t buffer)
     private_module_t* m = reinterpret_cast<private_module_t*>(
             dev->common.module);
 
+    // after whatever fb_postAsync() queued
+    pthread_mutex_lock(&ctx->flipLock);
+    while (ctx->flipCount)
+        pthread_cond_wait(&ctx->flipCond, &ctx->flipLock);
+    const int swapInterval = ctx->swapInterval;
+    const int64_t lastPost = ctx->lastPost;
+    bool waitForVsync = ctx->waitForVsync;
+    pthread_mutex_unlock(&ctx->flipLock);
+
+    if (swapInterval >= 2) {
+        fb_pace(m, swapInterval, lastPost, &waitForVsync);
+    }
+
+    bool flipped = false;
     if (hnd->flags & private_handle_t::PRIV_FLAGS_FRAMEBUFFER) {
-        const size_t offset = hnd->base - m->framebuffer->base;
-        m->info.activate = FB_ACTIVATE_VBL;
+        const size_t offset = hnd->offset;
+        // with a swap interval of 0 we flip right away, and may tear
+        m->info.activate = swapInterval ? FB_ACTIVATE_VBL : FB_ACTIVATE_NOW;
         m->info.yoffset = offset / m->finfo.line_length;
-        if (ioctl(m->framebuffer->fd, FBIOPUT_VSCREENINFO, &m->info) == -1) {
+        if (framebufferIoctl(m->framebuffer->fd,
+                FBIOPUT_VSCREENINFO, &m->info) == -1) {
+            int err = -errno;
             LOGE("FBIOPUT_VSCREENINFO failed");
+            fb_clearUpdateRect(m);
             m->base.unlock(&m->base, buffer); 
-            return -errno;
+            return err;
         }
-        m->currentBuffer = buffer;
+        flipped = true;
         
     } else {
         // If we can't do the page_flip, just copy the buffer to the front 
@@ -110,28 +368,68 @@ static int fb_post(struct framebuffer_device_t* dev, buffer_handle_t buffer)
         
         void* fb_vaddr;
         void* buffer_vaddr;
+        uint32_t l, t, r, b;
+        fb_getUpdateRect(m, &l, &t, &r, &b);
         
         m->base.lock(&m->base, m->framebuffer, 
                 GRALLOC_USAGE_SW_WRITE_RARELY, 
-                0, 0, m->info.xres, m->info.yres,
+                l, t, r-l, b-t,
                 &fb_vaddr);
 
         m->base.lock(&m->base, buffer, 
                 GRALLOC_USAGE_SW_READ_RARELY, 
-                0, 0, m->info.xres, m->info.yres,
+                l, t, r-l, b-t,
                 &buffer_vaddr);
 
-        memcpy(fb_vaddr, buffer_vaddr, m->finfo.line_length * m->info.yres);
+        // only the lines, and parts of lines, that changed. The buffer
+        // rows are usually shorter than the framebuffer's and its format
+        // may differ, the framebuffer is write-combined.
+        blit_buffer_t dst;
+        dst.base = fb_vaddr;
+        dst.bpr = m->finfo.line_length;
+        dst.format = m->framebuffer->format;
+        blit_buffer_t src;
+        src.base = buffer_vaddr;
+        src.bpr = hnd->stride * blitBytesPerPixel(hnd->format);
+        src.format = hnd->format;
+        if (!src.bpr) {
+            src.bpr = dst.bpr;
+            src.format = dst.format;
+        }
+        if (blitRect(&dst, &src, l, t, r-l, b-t, BLIT_NONTEMPORAL) < 0) {
+            LOGE("can't post a buffer of format %d", hnd->format);
+        }
         
         m->base.unlock(&m->base, buffer); 
         m->base.unlock(&m->base, m->framebuffer); 
     }
-    
+
+    fb_clearUpdateRect(m);
+
+    const int64_t done = fb_now();
+    pthread_mutex_lock(&ctx->flipLock);
+    if (flipped)
+        m->currentBuffer = buffer;
+    ctx->lastPost = done;
+    ctx->waitForVsync = waitForVsync;
+    pthread_mutex_unlock(&ctx->flipLock);
     return 0;
 }
 
 /*****************************************************************************/
 
+static uint32_t getMaxBuffers()
+{
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.gralloc.num_buffers", value, "0");
+    int n = atoi(value);
+    if (n <= 0)
+        n = NUM_BUFFERS;
+    if (n > MAX_FRAMEBUFFERS)
+        n = MAX_FRAMEBUFFERS;
+    return n;
+}
+
 int mapFrameBufferLocked(struct private_module_t* module)
 {
     // already initialized...
@@ -139,29 +437,16 @@ int mapFrameBufferLocked(struct private_module_t* module)
         return 0;
     }
         
-    char const * const device_template[] = {
-            "/dev/graphics/fb%u",
-            "/dev/fb%u",
-            0 };
-
-    int fd = -1;
-    int i=0;
-    char name[64];
-
-    while ((fd==-1) && device_template[i]) {
-        snprintf(name, 64, device_template[i], 0);
-        fd = open(name, O_RDWR, 0);
-        i++;
-    }
+    int fd = openFramebufferDevice();
     if (fd < 0)
-        return -errno;
+        return fd;
 
     struct fb_fix_screeninfo finfo;
-    if (ioctl(fd, FBIOGET_FSCREENINFO, &finfo) == -1)
+    if (framebufferIoctl(fd, FBIOGET_FSCREENINFO, &finfo) == -1)
         return -errno;
 
     struct fb_var_screeninfo info;
-    if (ioctl(fd, FBIOGET_VSCREENINFO, &info) == -1)
+    if (framebufferIoctl(fd, FBIOGET_VSCREENINFO, &info) == -1)
         return -errno;
 
     info.reserved[0] = 0;
@@ -172,16 +457,26 @@ int mapFrameBufferLocked(struct private_module_t* module)
     info.activate = FB_ACTIVATE_NOW;
 
     /*
-     * Request NUM_BUFFERS screens (at lest 2 for page flipping)
+     * Ask for as many screens as the driver accepts, starting from the
+     * configured maximum down to 2 for page flipping. If the driver
+     * refuses any change, fall back to whatever it gave us.
      */
-    info.yres_virtual = info.yres * NUM_BUFFERS;
-
-
+    const uint32_t maxBuffers = getMaxBuffers();
+    const uint32_t reported = info.yres_virtual;
     uint32_t flags = PAGE_FLIP;
-    if (ioctl(fd, FBIOPUT_VSCREENINFO, &info) == -1) {
-        info.yres_virtual = info.yres;
-        flags &= ~PAGE_FLIP;
-        LOGW("FBIOPUT_VSCREENINFO failed, page flipping not supported");
+    uint32_t n;
+    for (n = maxBuffers ; n >= 2 ; n--) {
+        info.yres_virtual = info.yres * n;
+        if (framebufferIoctl(fd, FBIOPUT_VSCREENINFO, &info) != -1)
+            break;
+    }
+    if (n < 2) {
+        info.yres_virtual = reported;
+        if (framebufferIoctl(fd, FBIOPUT_VSCREENINFO, &info) == -1) {
+            info.yres_virtual = info.yres;
+            flags &= ~PAGE_FLIP;
+            LOGW("FBIOPUT_VSCREENINFO failed, page flipping not supported");
+        }
     }
 
     if (info.yres_virtual < info.yres * 2) {
@@ -192,7 +487,7 @@ int mapFrameBufferLocked(struct private_module_t* module)
                 info.yres_virtual, info.yres*2);
     }
 
-    if (ioctl(fd, FBIOGET_VSCREENINFO, &info) == -1)
+    if (framebufferIoctl(fd, FBIOGET_VSCREENINFO, &info) == -1)
         return -errno;
 
     uint64_t  refreshQuotient =
@@ -253,7 +548,7 @@ int mapFrameBufferLocked(struct private_module_t* module)
     );
 
 
-    if (ioctl(fd, FBIOGET_FSCREENINFO, &finfo) == -1)
+    if (framebufferIoctl(fd, FBIOGET_FSCREENINFO, &finfo) == -1)
         return -errno;
 
     if (finfo.smem_len <= 0)
@@ -273,9 +568,16 @@ int mapFrameBufferLocked(struct private_module_t* module)
 
     int err;
     size_t fbSize = roundUpToPageSize(finfo.line_length * info.yres_virtual);
-    module->framebuffer = new private_handle_t(dup(fd), fbSize, 0);
+    module->framebuffer = new private_handle_t(dup(fd), fbSize,
+            private_handle_t::PRIV_FLAGS_FRAMEBUFFER);
+    module->framebuffer->format = (info.bits_per_pixel == 32)
+            ? HAL_PIXEL_FORMAT_RGBX_8888
+            : HAL_PIXEL_FORMAT_RGB_565;
+    module->framebuffer->stride = finfo.line_length / (info.bits_per_pixel >> 3);
 
     module->numBuffers = info.yres_virtual / info.yres;
+    if (module->numBuffers > maxBuffers)
+        module->numBuffers = maxBuffers;
     module->bufferMask = 0;
 
     void* vaddr = mmap(0, fbSize, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
@@ -283,7 +585,7 @@ int mapFrameBufferLocked(struct private_module_t* module)
         LOGE("Error mapping the framebuffer (%s)", strerror(errno));
         return -errno;
     }
-    module->framebuffer->base = intptr_t(vaddr);
+    module->framebufferBase = vaddr;
     memset(vaddr, 0, fbSize);
     return 0;
 }
@@ -302,6 +604,16 @@ static int fb_close(struct hw_device_t *dev)
 {
     fb_context_t* ctx = (fb_context_t*)dev;
     if (ctx) {
+        if (ctx->flipThreadStarted) {
+            // the pending flips are done first
+            pthread_mutex_lock(&ctx->flipLock);
+            ctx->exiting = true;
+            pthread_cond_broadcast(&ctx->flipCond);
+            pthread_mutex_unlock(&ctx->flipLock);
+            pthread_join(ctx->flipThread, NULL);
+        }
+        pthread_cond_destroy(&ctx->flipCond);
+        pthread_mutex_destroy(&ctx->flipLock);
         free(ctx);
     }
     return 0;
@@ -323,16 +635,31 @@ int fb_device_open(hw_module_t const* module, const char* name,
 
         /* initialize the procs */
         dev->device.common.tag = HARDWARE_DEVICE_TAG;
-        dev->device.common.version = 0;
+        dev->device.common.version = FRAMEBUFFER_DEVICE_API_VERSION_1;
         dev->device.common.module = const_cast<hw_module_t*>(module);
         dev->device.common.close = fb_close;
         dev->device.setSwapInterval = fb_setSwapInterval;
         dev->device.post            = fb_post;
         dev->device.setUpdateRect = 0;
+        dev->device.postAsync       = fb_postAsync;
+        dev->swapInterval = 1;
+        dev->waitForVsync = true;
+        pthread_mutex_init(&dev->flipLock, NULL);
+        pthread_cond_init(&dev->flipCond, NULL);
 
         private_module_t* m = (private_module_t*)module;
         status = mapFrameBuffer(m);
         if (status >= 0) {
+            // When we copy to the front buffer, only the update rect is
+            // copied and what's outside stays valid. When flipping, the
+            // panel must refresh from its own memory, which only the board
+            // can tell.
+#ifdef FB_PARTIAL_UPDATE
+            dev->device.setUpdateRect = fb_setUpdateRect;
+#else
+            if (m->numBuffers == 1)
+                dev->device.setUpdateRect = fb_setUpdateRect;
+#endif
             int stride = m->finfo.line_length / (m->info.bits_per_pixel >> 3);
             int format = (m->info.bits_per_pixel == 32)
                          ? HAL_PIXEL_FORMAT_RGBX_8888
@@ -345,8 +672,8 @@ int fb_device_open(hw_module_t const* module, const char* name,
             const_cast<float&>(dev->device.xdpi) = m->xdpi;
             const_cast<float&>(dev->device.ydpi) = m->ydpi;
             const_cast<float&>(dev->device.fps) = m->fps;
-            const_cast<int&>(dev->device.minSwapInterval) = 1;
-            const_cast<int&>(dev->device.maxSwapInterval) = 1;
+            const_cast<int&>(dev->device.minSwapInterval) = 0;
+            const_cast<int&>(dev->device.maxSwapInterval) = MAX_SWAP_INTERVAL;
             const_cast<int&>(dev->device.numFramebuffers) = m->numBuffers;
             *device = &dev->device.common;
         }
@@ -41,8 +41,42 @@ inline size_t roundUpToPageSize(size_t x) {
 }
 
 int mapFrameBufferLocked(struct private_module_t* module);
-int terminateBuffer(gralloc_module_t const* module, private_handle_t* hnd);
 int mapBuffer(gralloc_module_t const* module, private_handle_t* hnd);
+/* records <base> as the mapping of a buffer allocated in this process */
+void attachBuffer(private_handle_t const* hnd, void* base);
+/* forgets the mapping of a buffer and returns it, NULL if it had none */
+void* detachBuffer(private_handle_t const* hnd);
+
+int acquirePooledBuffer(size_t size, int* pFd, void** pBase);
+/* stocks a new buffer of <size>, after one was freed */
+void refillPool(size_t size);
+
+/*
+ * The memory and the display the module runs on, backend.cpp on the
+ * device and backend_host.cpp on the build host. These return -errno on
+ * failure, except framebufferIoctl() which behaves as ioctl().
+ */
+int createBufferRegion(size_t size);
+/*
+ * identifies the memory behind <fd> from what the kernel says about it,
+ * so that a mapping is never reused for a handle that merely carries the
+ * same ints
+ */
+struct region_key_t {
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t nonce;
+};
+int getBufferRegionKey(int fd, region_key_t* key);
+int openFramebufferDevice();
+int framebufferIoctl(int fd, int request, void* arg);
+
+/* whether the module maintains the CPU caches of an ashmem buffer of <usage> */
+bool needsCacheMaintenance(int usage);
+
+bool useHugePages(size_t size, int usage);
+int createHugePageBuffer(size_t* pSize);
+void* mapHugePageBuffer(int fd, size_t size);
 
 /*****************************************************************************/
 
@@ -26,10 +26,12 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/ioctl.h>
+#include <time.h>
 
 #include <cutils/ashmem.h>
 #include <cutils/log.h>
 #include <cutils/atomic.h>
+#include <cutils/properties.h>
 
 #include <hardware/hardware.h>
 #include <hardware/gralloc.h>
@@ -39,9 +41,54 @@
 
 /*****************************************************************************/
 
+/*
+ * Every buffer allocated through a device is recorded until it's freed, so
+ * that dumpsys SurfaceFlinger can tell what graphics memory is in use and
+ * by what, and how long each buffer has been around, which is usually
+ * what gives a leak away. Whatever is left when the device is closed is
+ * freed then.
+ *
+ * Buffers are allocated by SurfaceFlinger on behalf of its clients, and the
+ * HAL isn't told which client asked, so the records can't name the process
+ * that owns a buffer; the usage is what tells buffers apart.
+ */
+
+#define REGISTRY_BUCKETS    64
+
+enum {
+    USAGE_CLASS_FB,
+    USAGE_CLASS_VIDEO,
+    USAGE_CLASS_GPU,
+    USAGE_CLASS_COMPOSER,
+    USAGE_CLASS_SW,
+    USAGE_CLASS_OTHER,
+    NUM_USAGE_CLASSES
+};
+
+static char const* const sUsageClassNames[NUM_USAGE_CLASSES] = {
+    "fb", "video", "gpu", "composer", "sw", "other"
+};
+
+struct buffer_record_t {
+    buffer_record_t* next;
+    private_handle_t* hnd;
+    int w;
+    int h;
+    int usageClass;
+    // CLOCK_MONOTONIC, in seconds
+    time_t allocated;
+};
+
 struct gralloc_context_t {
     alloc_device_t  device;
     /* our private data here */
+    pthread_mutex_t lock;
+    buffer_record_t* buffers[REGISTRY_BUCKETS];
+    size_t count;
+    size_t bytes;
+    size_t classBytes[NUM_USAGE_CLASSES];
+    size_t peakCount;
+    size_t peakBytes;
 };
 
 static int gralloc_alloc_buffer(alloc_device_t* dev,
@@ -92,6 +139,7 @@ struct private_module_t HAL_MODULE_INFO_SYM = {
         unlock: gralloc_unlock,
     },
     framebuffer: 0,
+    framebufferBase: 0,
     flags: 0,
     numBuffers: 0,
     bufferMask: 0,
@@ -101,23 +149,56 @@ struct private_module_t HAL_MODULE_INFO_SYM = {
 
 /*****************************************************************************/
 
-static int gralloc_alloc_framebuffer_locked(alloc_device_t* dev,
-        size_t size, int usage, buffer_handle_t* pHandle)
+// identifies buffers in the mapping tables of the processes they're sent to
+static volatile int32_t sNextBufferId = 1;
+
+/* atomically claims the lowest free framebuffer, or returns -ENOMEM */
+static int allocFramebufferSlot(private_module_t* m)
+{
+    const uint32_t numBuffers = m->numBuffers;
+    const uint32_t all = (numBuffers >= MAX_FRAMEBUFFERS) ?
+            ~0U : ((1U << numBuffers) - 1);
+    int32_t mask;
+    int index;
+    do {
+        mask = android_atomic_acquire_load(&m->bufferMask);
+        const uint32_t available = ~uint32_t(mask) & all;
+        if (!available) {
+            // We ran out of buffers.
+            return -ENOMEM;
+        }
+        index = __builtin_ctz(available);
+    } while (android_atomic_cmpxchg(mask, mask | (1U << index),
+            &m->bufferMask));
+    return index;
+}
+
+static void freeFramebufferSlot(private_module_t* m, int index)
+{
+    android_atomic_and(~(1U << index), &m->bufferMask);
+}
+
+static int gralloc_alloc_framebuffer(alloc_device_t* dev,
+        int usage, buffer_handle_t* pHandle)
 {
     private_module_t* m = reinterpret_cast<private_module_t*>(
             dev->common.module);
 
     // allocate the framebuffer
+    pthread_mutex_lock(&m->lock);
+    int err = 0;
     if (m->framebuffer == NULL) {
         // initialize the framebuffer, the framebuffer is mapped once
         // and forever.
-        int err = mapFrameBufferLocked(m);
-        if (err < 0) {
-            return err;
-        }
+        err = mapFrameBufferLocked(m);
+    }
+    pthread_mutex_unlock(&m->lock);
+    if (err < 0) {
+        return err;
     }
 
-    const uint32_t bufferMask = m->bufferMask;
+    // numBuffers and the mapping don't change once initialized, only the
+    // slots are shared with concurrent alloc/free and need to be atomic
     const uint32_t numBuffers = m->numBuffers;
     const size_t bufferSize = m->finfo.line_length * m->info.yres;
     if (numBuffers == 1) {
@@ -128,43 +209,22 @@ static int gralloc_alloc_framebuffer_locked(alloc_device_t* dev,
         return gralloc_alloc_buffer(dev, bufferSize, newUsage, pHandle);
     }
 
-    if (bufferMask >= ((1LU<<numBuffers)-1)) {
-        // We ran out of buffers.
-        return -ENOMEM;
+    const int index = allocFramebufferSlot(m);
+    if (index < 0) {
+        return index;
     }
 
-    // create a "fake" handles for it
-    intptr_t vaddr = intptr_t(m->framebuffer->base);
-    private_handle_t* hnd = new private_handle_t(dup(m->framebuffer->fd), size,
-            private_handle_t::PRIV_FLAGS_FRAMEBUFFER);
-
-    // find a free slot
-    for (uint32_t i=0 ; i<numBuffers ; i++) {
-        if ((bufferMask & (1LU<<i)) == 0) {
-            m->bufferMask |= (1LU<<i);
-            break;
-        }
-        vaddr += bufferSize;
-    }
-    
-    hnd->base = vaddr;
-    hnd->offset = vaddr - intptr_t(m->framebuffer->base);
+    // create a "fake" handles for it, of the size of its slot whatever the
+    // alignment of the usage asked for: the rows are the display's
+    private_handle_t* hnd = new private_handle_t(dup(m->framebuffer->fd),
+            bufferSize, private_handle_t::PRIV_FLAGS_FRAMEBUFFER);
+    hnd->offset = index * bufferSize;
+    hnd->id = android_atomic_inc(&sNextBufferId);
     *pHandle = hnd;
 
     return 0;
 }
 
-static int gralloc_alloc_framebuffer(alloc_device_t* dev,
-        size_t size, int usage, buffer_handle_t* pHandle)
-{
-    private_module_t* m = reinterpret_cast<private_module_t*>(
-            dev->common.module);
-    pthread_mutex_lock(&m->lock);
-    int err = gralloc_alloc_framebuffer_locked(dev, size, usage, pHandle);
-    pthread_mutex_unlock(&m->lock);
-    return err;
-}
-
 static int gralloc_alloc_buffer(alloc_device_t* dev,
         size_t size, int usage, buffer_handle_t* pHandle)
 {
@@ -172,18 +232,43 @@ static int gralloc_alloc_buffer(alloc_device_t* dev,
     int fd = -1;
 
     size = roundUpToPageSize(size);
-    
-    fd = ashmem_create_region("gralloc-buffer", size);
-    if (fd < 0) {
-        LOGE("couldn't create ashmem (%s)", strerror(-errno));
-        err = -errno;
+
+    int flags = 0;
+    if (useHugePages(size, usage)) {
+        fd = createHugePageBuffer(&size);
+        if (fd >= 0) {
+            flags |= private_handle_t::PRIV_FLAGS_HUGEPAGE;
+        } else {
+            LOGW_IF(fd != -ENOSYS, "couldn't create huge page buffer (%s), "
+                    "using ashmem", strerror(-fd));
+        }
     }
 
-    if (err == 0) {
+    void* base;
+    if (!flags && acquirePooledBuffer(size, &fd, &base) == 0) {
         private_handle_t* hnd = new private_handle_t(fd, size, 0);
-        gralloc_module_t* module = reinterpret_cast<gralloc_module_t*>(
-                dev->common.module);
-        err = mapBuffer(module, hnd);
+        hnd->id = android_atomic_inc(&sNextBufferId);
+        attachBuffer(hnd, base);
+        *pHandle = hnd;
+        return 0;
+    }
+
+    if (!flags) {
+        fd = createBufferRegion(size);
+        if (fd < 0) {
+            err = fd;
+        }
+    }
+
+    if (err == 0) {
+        private_handle_t* hnd = new private_handle_t(fd, size, flags);
+        hnd->id = android_atomic_inc(&sNextBufferId);
+        if (usage & (GRALLOC_USAGE_SW_READ_MASK|GRALLOC_USAGE_SW_WRITE_MASK)) {
+            gralloc_module_t* module = reinterpret_cast<gralloc_module_t*>(
+                    dev->common.module);
+            err = mapBuffer(module, hnd);
+        }
+        // otherwise the CPU may never touch it, the first lock maps it
         if (err == 0) {
             *pHandle = hnd;
         }
@@ -196,6 +281,185 @@ static int gralloc_alloc_buffer(alloc_device_t* dev,
 
 /*****************************************************************************/
 
+/*
+ * Row alignment, in bytes, for each class of usage. A buffer gets the
+ * largest alignment of all the classes in its usage, and framebuffers the
+ * line length of the display. The defaults suit SIMD code, the cache
+ * lines of software-rendered buffers, the bursts of 2D engines and the
+ * tiles of a GPU; each can be overridden with the debug.gralloc.align.*
+ * properties, for instance to page-align the rows of a DMA engine that
+ * needs it.
+ */
+struct align_policy_t {
+    size_t sw;
+    size_t swOften;
+    size_t hw2d;
+    // in pixels, the rows are also padded to a multiple of this
+    size_t texture;
+};
+
+static align_policy_t sAlign;
+static pthread_once_t sAlignOnce = PTHREAD_ONCE_INIT;
+
+static size_t getAlignProperty(const char* key, size_t def)
+{
+    char value[PROPERTY_VALUE_MAX];
+    property_get(key, value, "0");
+    const int align = atoi(value);
+    if (align <= 0)
+        return def;
+    if (align & (align - 1)) {
+        LOGW("%s=%d is not a power of 2, using %d", key, align, int(def));
+        return def;
+    }
+    return align;
+}
+
+static void initAlignPolicy()
+{
+    sAlign.sw       = getAlignProperty("debug.gralloc.align.sw", 16);
+    sAlign.swOften  = getAlignProperty("debug.gralloc.align.sw_often", 64);
+    sAlign.hw2d     = getAlignProperty("debug.gralloc.align.2d", 64);
+    sAlign.texture  = getAlignProperty("debug.gralloc.align.texture", 32);
+}
+
+static size_t getRowAlignment(int usage, int bpp)
+{
+    pthread_once(&sAlignOnce, initAlignPolicy);
+    const int read = usage & GRALLOC_USAGE_SW_READ_MASK;
+    const int write = usage & GRALLOC_USAGE_SW_WRITE_MASK;
+    size_t align = 4;
+    if (read == GRALLOC_USAGE_SW_READ_OFTEN ||
+            write == GRALLOC_USAGE_SW_WRITE_OFTEN) {
+        align = sAlign.swOften;
+    } else if (read || write) {
+        align = sAlign.sw;
+    }
+    if ((usage & GRALLOC_USAGE_HW_2D) && sAlign.hw2d > align)
+        align = sAlign.hw2d;
+    if ((usage & (GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_RENDER)) &&
+            sAlign.texture * bpp > align) {
+        align = sAlign.texture * bpp;
+    }
+    return align;
+}
+
+/*****************************************************************************/
+
+static int getUsageClass(int usage)
+{
+    if (usage & GRALLOC_USAGE_HW_FB)
+        return USAGE_CLASS_FB;
+    if (usage & GRALLOC_USAGE_HW_VIDEO_ENCODER)
+        return USAGE_CLASS_VIDEO;
+    if (usage & (GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_RENDER))
+        return USAGE_CLASS_GPU;
+    if (usage & (GRALLOC_USAGE_HW_COMPOSER | GRALLOC_USAGE_HW_2D))
+        return USAGE_CLASS_COMPOSER;
+    if (usage & (GRALLOC_USAGE_SW_READ_MASK | GRALLOC_USAGE_SW_WRITE_MASK))
+        return USAGE_CLASS_SW;
+    return USAGE_CLASS_OTHER;
+}
+
+static time_t now()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec;
+}
+
+static inline buffer_record_t** recordBucket(gralloc_context_t* ctx, int id)
+{
+    return &ctx->buffers[uint32_t(id) % REGISTRY_BUCKETS];
+}
+
+static void recordBuffer(gralloc_context_t* ctx, private_handle_t* hnd,
+        int w, int h)
+{
+    buffer_record_t* r = new buffer_record_t;
+    r->hnd = hnd;
+    r->w = w;
+    r->h = h;
+    r->usageClass = getUsageClass(hnd->usage);
+    r->allocated = now();
+
+    pthread_mutex_lock(&ctx->lock);
+    buffer_record_t** bucket = recordBucket(ctx, hnd->id);
+    r->next = *bucket;
+    *bucket = r;
+    ctx->count++;
+    ctx->bytes += hnd->size;
+    ctx->classBytes[r->usageClass] += hnd->size;
+    if (ctx->count > ctx->peakCount)
+        ctx->peakCount = ctx->count;
+    if (ctx->bytes > ctx->peakBytes)
+        ctx->peakBytes = ctx->bytes;
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+static void forgetBufferLocked(gralloc_context_t* ctx, buffer_record_t** p)
+{
+    buffer_record_t* r = *p;
+    *p = r->next;
+    ctx->count--;
+    ctx->bytes -= r->hnd->size;
+    ctx->classBytes[r->usageClass] -= r->hnd->size;
+    delete r;
+}
+
+static void forgetBuffer(gralloc_context_t* ctx, private_handle_t const* hnd)
+{
+    pthread_mutex_lock(&ctx->lock);
+    buffer_record_t** p = recordBucket(ctx, hnd->id);
+    while (*p && (*p)->hnd != hnd)
+        p = &(*p)->next;
+    if (*p) {
+        forgetBufferLocked(ctx, p);
+    } else {
+        LOGW("freeing buffer %p which wasn't allocated by this device", hnd);
+    }
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+static void gralloc_dump(alloc_device_t* dev, char* buff, int buff_len)
+{
+    gralloc_context_t* ctx = reinterpret_cast<gralloc_context_t*>(dev);
+    if (buff_len <= 0)
+        return;
+
+    int n = 0;
+#define APPEND(...) \
+    do { \
+        if (n < buff_len) \
+            n += snprintf(buff + n, buff_len - n, __VA_ARGS__); \
+    } while (0)
+
+    pthread_mutex_lock(&ctx->lock);
+    APPEND("Allocated buffers: %d, %d KB (peak %d, %d KB)\n",
+            int(ctx->count), int(ctx->bytes / 1024),
+            int(ctx->peakCount), int(ctx->peakBytes / 1024));
+    for (int c=0 ; c<NUM_USAGE_CLASSES ; c++) {
+        APPEND(" %s %d KB", sUsageClassNames[c],
+                int(ctx->classBytes[c] / 1024));
+    }
+    APPEND("\n %-10s %5s %9s %6s %8s %-8s %6s %6s\n", "handle", "id",
+            "w x h", "format", "usage", "class", "KB", "age(s)");
+    const time_t t = now();
+    for (int i=0 ; i<REGISTRY_BUCKETS ; i++) {
+        for (buffer_record_t* r = ctx->buffers[i] ; r ; r = r->next) {
+            const private_handle_t* hnd = r->hnd;
+            APPEND(" %10p %5d %4dx%-4d %6d %08x %-8s %6d %6d\n", hnd,
+                    hnd->id, r->w, r->h, hnd->format, hnd->usage,
+                    sUsageClassNames[r->usageClass], hnd->size / 1024,
+                    int(t - r->allocated));
+        }
+    }
+    pthread_mutex_unlock(&ctx->lock);
+#undef APPEND
+}
+
+/*****************************************************************************/
+
 static int gralloc_alloc(alloc_device_t* dev,
         int w, int h, int format, int usage,
         buffer_handle_t* pHandle, int* pStride)
@@ -205,8 +469,9 @@ static int gralloc_alloc(alloc_device_t* dev,
 
     size_t size, stride;
 
-    int align = 4;
+    size_t align;
     int bpp = 0;
+    int rows = h;
     switch (format) {
         case HAL_PIXEL_FORMAT_RGBA_8888:
         case HAL_PIXEL_FORMAT_RGBX_8888:
@@ -221,16 +486,50 @@ static int gralloc_alloc(alloc_device_t* dev,
         case HAL_PIXEL_FORMAT_RGBA_4444:
             bpp = 2;
             break;
+        case HAL_PIXEL_FORMAT_YV12:
+        case HAL_PIXEL_FORMAT_YCrCb_420_SP:
+        case HAL_PIXEL_FORMAT_YCbCr_422_SP:
+            // the stride is the luma plane's, the chroma planes follow it
+            if (((w|h) & 1) || (usage & GRALLOC_USAGE_HW_FB))
+                return -EINVAL;
+            bpp = 1;
+            break;
         default:
             return -EINVAL;
     }
-    size_t bpr = (w*bpp + (align-1)) & ~(align-1);
-    size = bpr * h;
+
+    align = getRowAlignment(usage, bpp);
+    if (bpp == 1 && align < 16) {
+        // YV12 requires it, and it can't hurt the others
+        align = 16;
+    }
+    if (usage & (GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_RENDER)) {
+        // whole tiles, vertically as well
+        rows = (h + sAlign.texture - 1) / sAlign.texture * sAlign.texture;
+    }
+
+    size_t bpr = (w*bpp + (align-1)) / align * align;
+    size = bpr * rows;
     stride = bpr / bpp;
 
+    switch (format) {
+        case HAL_PIXEL_FORMAT_YV12:
+            // V then U, each h/2 rows of a 16-byte aligned half stride
+            size += ((bpr/2 + 15) & ~15) * h;
+            break;
+        case HAL_PIXEL_FORMAT_YCrCb_420_SP:
+            // NV21, h/2 rows of interleaved V and U at the luma stride
+            size += bpr * h/2;
+            break;
+        case HAL_PIXEL_FORMAT_YCbCr_422_SP:
+            // NV16, h rows of interleaved U and V at the luma stride
+            size += bpr * h;
+            break;
+    }
+
     int err;
     if (usage & GRALLOC_USAGE_HW_FB) {
-        err = gralloc_alloc_framebuffer(dev, size, usage, pHandle);
+        err = gralloc_alloc_framebuffer(dev, usage, pHandle);
     } else {
         err = gralloc_alloc_buffer(dev, size, usage, pHandle);
     }
@@ -239,32 +538,59 @@ static int gralloc_alloc(alloc_device_t* dev,
         return err;
     }
 
+    private_module_t* m = reinterpret_cast<private_module_t*>(
+            dev->common.module);
+    if ((usage & GRALLOC_USAGE_HW_FB) &&
+            bpp*8 == int(m->info.bits_per_pixel)) {
+        // flipped or copied to the screen, the rows are the display's
+        stride = m->framebuffer->stride;
+    }
+
+    private_handle_t* hnd = (private_handle_t*)*pHandle;
+    hnd->format = format;
+    hnd->stride = stride;
+    hnd->usage = usage;
     *pStride = stride;
+
+    recordBuffer(reinterpret_cast<gralloc_context_t*>(dev), hnd, w, h);
     return 0;
 }
 
-static int gralloc_free(alloc_device_t* dev,
-        buffer_handle_t handle)
+static void gralloc_free_buffer(alloc_device_t* dev,
+        private_handle_t const* hnd, bool refill)
 {
-    if (private_handle_t::validate(handle) < 0)
-        return -EINVAL;
-
-    private_handle_t const* hnd = reinterpret_cast<private_handle_t const*>(handle);
+    forgetBuffer(reinterpret_cast<gralloc_context_t*>(dev), hnd);
     if (hnd->flags & private_handle_t::PRIV_FLAGS_FRAMEBUFFER) {
         // free this buffer
         private_module_t* m = reinterpret_cast<private_module_t*>(
                 dev->common.module);
         const size_t bufferSize = m->finfo.line_length * m->info.yres;
-        int index = (hnd->base - m->framebuffer->base) / bufferSize;
-        m->bufferMask &= ~(1<<index); 
-    } else { 
-        gralloc_module_t* module = reinterpret_cast<gralloc_module_t*>(
-                dev->common.module);
-        terminateBuffer(module, const_cast<private_handle_t*>(hnd));
+        freeFramebufferSlot(m, hnd->offset / bufferSize);
+    } else {
+        void* base = detachBuffer(hnd);
+        if (base) {
+            if (munmap(base, hnd->size) < 0) {
+                LOGE("Could not unmap %s", strerror(errno));
+            }
+        }
     }
 
     close(hnd->fd);
+    if (refill && !(hnd->flags & (private_handle_t::PRIV_FLAGS_FRAMEBUFFER |
+            private_handle_t::PRIV_FLAGS_HUGEPAGE))) {
+        refillPool(hnd->size);
+    }
     delete hnd;
+}
+
+static int gralloc_free(alloc_device_t* dev,
+        buffer_handle_t handle)
+{
+    if (private_handle_t::validate(handle) < 0)
+        return -EINVAL;
+
+    private_handle_t const* hnd = reinterpret_cast<private_handle_t const*>(handle);
+    gralloc_free_buffer(dev, hnd, true);
     return 0;
 }
 
@@ -274,9 +600,19 @@ static int gralloc_close(struct hw_device_t *dev)
 {
     gralloc_context_t* ctx = reinterpret_cast<gralloc_context_t*>(dev);
     if (ctx) {
-        /* TODO: keep a list of all buffer_handle_t created, and free them
-         * all here.
-         */
+        // whatever wasn't freed was leaked, its owners are gone
+        if (ctx->count) {
+            LOGW("closing with %d buffers (%d KB) still allocated",
+                    int(ctx->count), int(ctx->bytes / 1024));
+        }
+        // nothing will be allocated through this device again, so the
+        // pool isn't refilled for them
+        for (int i=0 ; i<REGISTRY_BUCKETS ; i++) {
+            while (ctx->buffers[i]) {
+                gralloc_free_buffer(&ctx->device, ctx->buffers[i]->hnd, false);
+            }
+        }
+        pthread_mutex_destroy(&ctx->lock);
         free(ctx);
     }
     return 0;
@@ -292,6 +628,7 @@ int gralloc_device_open(const hw_module_t* module, const char* name,
 
         /* initialize our state here */
         memset(dev, 0, sizeof(*dev));
+        pthread_mutex_init(&dev->lock, NULL);
 
         /* initialize the procs */
         dev->device.common.tag = HARDWARE_DEVICE_TAG;
@@ -301,6 +638,7 @@ int gralloc_device_open(const hw_module_t* module, const char* name,
 
         dev->device.alloc   = gralloc_alloc;
         dev->device.free    = gralloc_free;
+        dev->device.dump    = gralloc_dump;
 
         *device = &dev->device.common;
         status = 0;
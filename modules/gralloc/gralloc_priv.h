@@ -34,13 +34,18 @@
 struct private_module_t;
 struct private_handle_t;
 
+/* one bit of bufferMask per framebuffer */
+#define MAX_FRAMEBUFFERS    32
+
 struct private_module_t {
     gralloc_module_t base;
 
     private_handle_t* framebuffer;
+    // where this process mapped it
+    void* framebufferBase;
     uint32_t flags;
     uint32_t numBuffers;
-    uint32_t bufferMask;
+    volatile int32_t bufferMask;
     pthread_mutex_t lock;
     buffer_handle_t currentBuffer;
     int pmem_master;
@@ -63,9 +68,14 @@ struct private_handle_t {
 #endif
     
     enum {
-        PRIV_FLAGS_FRAMEBUFFER = 0x00000001
+        PRIV_FLAGS_FRAMEBUFFER = 0x00000001,
+        // a memfd to be mapped on a huge page boundary
+        PRIV_FLAGS_HUGEPAGE    = 0x00000002
     };
 
+    // only what holds in every process the handle is sent to, the
+    // mapping and lock state are kept by each process, see mapper.cpp
+
     // file-descriptors
     int     fd;
     // ints
@@ -73,19 +83,24 @@ struct private_handle_t {
     int     flags;
     int     size;
     int     offset;
-
-    // FIXME: the attributes below should be out-of-line
-    int     base;
+    int     format;
+    // in pixels
+    int     stride;
+    // unique among the buffers allocated by <pid>
+    int     id;
+    // as allocated
+    int     usage;
+    // of the process that allocated it
     int     pid;
 
 #ifdef __cplusplus
-    static const int sNumInts = 6;
+    static const int sNumInts = 9;
     static const int sNumFds = 1;
     static const int sMagic = 0x3141592;
 
     private_handle_t(int fd, int size, int flags) :
         fd(fd), magic(sMagic), flags(flags), size(size), offset(0),
-        base(0), pid(getpid())
+        format(0), stride(0), id(0), usage(0), pid(getpid())
     {
         version = sizeof(native_handle);
         numInts = sNumInts;
@@ -0,0 +1,222 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
+#include "gralloc_priv.h"
+#include "gr.h"
+
+/*****************************************************************************/
+
+/*
+ * Large buffers can be backed by a memfd instead of ashmem, so that they can
+ * be mapped with huge pages: a full-screen buffer then takes a couple of TLB
+ * entries and a couple of page faults instead of a thousand of each.
+ *
+ * debug.gralloc.hugepage selects the backing:
+ *      "auto"      "thp" if the kernel gives huge pages to madvise()d shmem,
+ *                  as set in /sys/kernel/mm/transparent_hugepage/shmem_enabled,
+ *                  "0" otherwise (default)
+ *      "0"         ashmem only
+ *      "thp"       transparent huge pages on a memfd
+ *      "hugetlb"   a memfd from the hugetlb pool. The buffer size is rounded
+ *                  up to a whole huge page.
+ *
+ * A memfd can't be purged, or pooled, so buffers only leave ashmem where
+ * huge pages are actually used.
+ *
+ * Buffers of at least debug.gralloc.hugepage_min KB use it, and buffers
+ * the CPU accesses often as soon as they fill one huge page. Buffers that
+ * need their caches maintained stay on ashmem, which is the only memory
+ * we can do that for. Whenever a memfd can't be created the buffer falls
+ * back to ashmem.
+ *
+ * Every client gets the memfd, and unlike ashmem nothing fixes its size
+ * once it's mapped, so it's sealed against resizing: a client truncating
+ * it would have SurfaceFlinger take SIGBUS on its next access.
+ */
+
+#ifndef HUGE_PAGE_SIZE
+#define HUGE_PAGE_SIZE      (2*1024*1024)
+#endif
+
+// in KB
+#define HUGEPAGE_DEFAULT_MIN    "4096"
+
+#define THP_SHMEM_ENABLED   "/sys/kernel/mm/transparent_hugepage/shmem_enabled"
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC         0x0001U
+#endif
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING   0x0002U
+#endif
+#ifndef MFD_HUGETLB
+#define MFD_HUGETLB         0x0004U
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS         (1024 + 9)
+#endif
+#ifndef F_SEAL_SHRINK
+#define F_SEAL_SHRINK       0x0002
+#endif
+#ifndef F_SEAL_GROW
+#define F_SEAL_GROW         0x0004
+#endif
+
+enum {
+    HUGEPAGE_OFF,
+    HUGEPAGE_THP,
+    HUGEPAGE_HUGETLB
+};
+
+static int sMode;
+static size_t sMinSize;
+static pthread_once_t sHugePageOnce = PTHREAD_ONCE_INIT;
+
+/* whether shmem_enabled selects a mode that honors MADV_HUGEPAGE */
+static bool shmemHugePagesEnabled()
+{
+    char buf[128];
+    int fd = open(THP_SHMEM_ENABLED, O_RDONLY);
+    if (fd < 0)
+        return false;
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0)
+        return false;
+    buf[n] = 0;
+    // the modes are listed, the current one in brackets
+    return strstr(buf, "[always]") || strstr(buf, "[within_size]") ||
+            strstr(buf, "[advise]") || strstr(buf, "[force]");
+}
+
+static void initHugePagePolicy()
+{
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.gralloc.hugepage", value, "auto");
+    if (!strcmp(value, "auto")) {
+        sMode = shmemHugePagesEnabled() ? HUGEPAGE_THP : HUGEPAGE_OFF;
+    } else if (!strcmp(value, "thp")) {
+        sMode = HUGEPAGE_THP;
+    } else if (!strcmp(value, "hugetlb")) {
+        sMode = HUGEPAGE_HUGETLB;
+    } else {
+        sMode = HUGEPAGE_OFF;
+    }
+    property_get("debug.gralloc.hugepage_min", value, HUGEPAGE_DEFAULT_MIN);
+    sMinSize = size_t(atoi(value)) * 1024;
+    if (sMinSize < HUGE_PAGE_SIZE)
+        sMinSize = HUGE_PAGE_SIZE;
+}
+
+static int memfdCreate(const char* name, unsigned int flags)
+{
+#ifdef __NR_memfd_create
+    return syscall(__NR_memfd_create, name, flags);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/*****************************************************************************/
+
+bool useHugePages(size_t size, int usage)
+{
+    pthread_once(&sHugePageOnce, initHugePagePolicy);
+    if (sMode == HUGEPAGE_OFF || size < HUGE_PAGE_SIZE ||
+            needsCacheMaintenance(usage))
+        return false;
+    const int read = usage & GRALLOC_USAGE_SW_READ_MASK;
+    const int write = usage & GRALLOC_USAGE_SW_WRITE_MASK;
+    if (read == GRALLOC_USAGE_SW_READ_OFTEN ||
+            write == GRALLOC_USAGE_SW_WRITE_OFTEN) {
+        return true;
+    }
+    return size >= sMinSize;
+}
+
+int createHugePageBuffer(size_t* pSize)
+{
+    size_t size = *pSize;
+    unsigned int flags = MFD_CLOEXEC | MFD_ALLOW_SEALING;
+    if (sMode == HUGEPAGE_HUGETLB) {
+        flags |= MFD_HUGETLB;
+        size = (size + HUGE_PAGE_SIZE-1) & ~(HUGE_PAGE_SIZE-1);
+    }
+
+    int fd = memfdCreate("gralloc-buffer", flags);
+    if (fd < 0) {
+        return -errno;
+    }
+    if (ftruncate(fd, size) < 0 ||
+            fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) < 0) {
+        int err = -errno;
+        close(fd);
+        return err;
+    }
+    *pSize = size;
+    return fd;
+}
+
+void* mapHugePageBuffer(int fd, size_t size)
+{
+    // reserve enough address space to place the mapping on a huge page
+    // boundary, without which the kernel can't use huge pages for it
+    const size_t reserved = size + HUGE_PAGE_SIZE;
+    void* area = mmap(0, reserved, PROT_NONE,
+            MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (area == MAP_FAILED)
+        return MAP_FAILED;
+
+    const uintptr_t start = uintptr_t(area);
+    const uintptr_t aligned = (start + HUGE_PAGE_SIZE-1) & ~uintptr_t(HUGE_PAGE_SIZE-1);
+    void* base = mmap((void*)aligned, size, PROT_READ|PROT_WRITE,
+            MAP_SHARED|MAP_FIXED, fd, 0);
+    if (base == MAP_FAILED) {
+        int err = errno;
+        munmap(area, reserved);
+        errno = err;
+        return MAP_FAILED;
+    }
+
+    // give back what's left of the reservation on both sides
+    const size_t mapped = roundUpToPageSize(size);
+    if (aligned > start)
+        munmap(area, aligned - start);
+    if (start + reserved > aligned + mapped)
+        munmap((void*)(aligned + mapped), start + reserved - (aligned + mapped));
+
+#ifdef MADV_HUGEPAGE
+    // a hugetlb mapping doesn't need it, and a kernel without THP
+    // rejects it, which only means small pages
+    madvise(base, size, MADV_HUGEPAGE);
+#endif
+    return base;
+}
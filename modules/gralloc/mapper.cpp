@@ -18,19 +18,28 @@
 #include <errno.h>
 #include <pthread.h>
 #include <unistd.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+#if HAVE_ANDROID_OS
+#include <linux/ashmem.h>
+#endif
 
 #include <cutils/log.h>
 #include <cutils/atomic.h>
+#include <cutils/properties.h>
 
 #include <hardware/hardware.h>
 #include <hardware/gralloc.h>
 
 #include "gralloc_priv.h"
+#include "gr.h"
 
 
 /* desktop Linux needs a little help with gettid() */
@@ -43,46 +52,189 @@ pid_t gettid() { return syscall(__NR_gettid);}
 
 /*****************************************************************************/
 
-static int gralloc_map(gralloc_module_t const* module,
-        buffer_handle_t handle,
-        void** vaddr)
+/*
+ * The handle only carries what every process can share. Where a buffer is
+ * mapped in this process, and what it's currently locked for, is kept here
+ * in a mapping keyed by the pid of the process that allocated the buffer
+ * and an id unique in that process; the size must match too.
+ *
+ * Those are only ints copied from the handle, and pids get reused, so
+ * registering a handle also checks that its fd is the memory the mapping
+ * was made from, see getBufferRegionKey(). There's never more than one
+ * mapping for a pid, id and size.
+ *
+ * Buffers allocated here hold their mapping from the time they're first
+ * mapped until they're freed. Buffers from other processes are registered
+ * and unregistered every time they go through a BufferQueue. Their
+ * mappings are kept once unregistered, so that registering the same buffer
+ * again doesn't mmap() it again. The least recently unregistered mapping
+ * goes first.
+ *
+ * A cached mapping keeps the buffer's pages resident in this process even
+ * after its owner freed it, and a freed buffer's pid and id never come back,
+ * so the cache is budgeted in resident memory: debug.gralloc.map_cache KB,
+ * a few screen-sized buffers by default, 0 disables it.
+ *
+ * The framebuffer is mapped once by the module, its buffers are offsets
+ * into that mapping.
+ */
+
+#define MAP_CACHE_BUCKETS       64
+
+// in KB, about two 32bpp WVGA buffers
+#define MAP_CACHE_DEFAULT_SIZE  "4096"
+
+struct mapping_t {
+    mapping_t* hashNext;
+    // in the LRU list while unreferenced
+    mapping_t* lruPrev;
+    mapping_t* lruNext;
+    int pid;
+    int id;
+    size_t size;
+    // of the memory mapped, for remote buffers
+    region_key_t key;
+    void* base;
+    int refs;
+    // what the current lock is for
+    int lockUsage;
+};
+
+static pthread_mutex_t sMapLock = PTHREAD_MUTEX_INITIALIZER;
+static mapping_t* sMappings[MAP_CACHE_BUCKETS];
+static mapping_t* sLruHead;
+static mapping_t* sLruTail;
+static size_t sCachedBytes;
+static size_t sCacheBudget;
+static bool sCacheInitialized = false;
+
+static void* mapRegion(private_handle_t const* hnd)
 {
-    private_handle_t* hnd = (private_handle_t*)handle;
-    if (!(hnd->flags & private_handle_t::PRIV_FLAGS_FRAMEBUFFER)) {
-        size_t size = hnd->size;
-        void* mappedAddress = mmap(0, size,
+    void* mappedAddress;
+    if (hnd->flags & private_handle_t::PRIV_FLAGS_HUGEPAGE) {
+        mappedAddress = mapHugePageBuffer(hnd->fd, hnd->size);
+    } else {
+        mappedAddress = mmap(0, hnd->size,
                 PROT_READ|PROT_WRITE, MAP_SHARED, hnd->fd, 0);
-        if (mappedAddress == MAP_FAILED) {
-            LOGE("Could not mmap %s", strerror(errno));
-            return -errno;
-        }
-        hnd->base = intptr_t(mappedAddress) + hnd->offset;
-        //LOGD("gralloc_map() succeeded fd=%d, off=%d, size=%d, vaddr=%p",
-        //        hnd->fd, hnd->offset, hnd->size, mappedAddress);
     }
-    *vaddr = (void*)hnd->base;
-    return 0;
+    if (mappedAddress == MAP_FAILED) {
+        LOGE("Could not mmap %s", strerror(errno));
+        return NULL;
+    }
+    //LOGD("mapRegion() succeeded fd=%d, size=%d, vaddr=%p",
+    //        hnd->fd, hnd->size, mappedAddress);
+    return mappedAddress;
 }
 
-static int gralloc_unmap(gralloc_module_t const* module,
-        buffer_handle_t handle)
+static void unmapRegion(void* base, size_t size)
 {
-    private_handle_t* hnd = (private_handle_t*)handle;
-    if (!(hnd->flags & private_handle_t::PRIV_FLAGS_FRAMEBUFFER)) {
-        void* base = (void*)hnd->base;
-        size_t size = hnd->size;
-        //LOGD("unmapping from %p, size=%d", base, size);
-        if (munmap(base, size) < 0) {
-            LOGE("Could not unmap %s", strerror(errno));
-        }
+    //LOGD("unmapping from %p, size=%d", base, size);
+    if (munmap(base, size) < 0) {
+        LOGE("Could not unmap %s", strerror(errno));
     }
-    hnd->base = 0;
-    return 0;
 }
 
-/*****************************************************************************/
+static inline mapping_t** bucketFor(int pid, int id)
+{
+    return &sMappings[uint32_t(pid * 31 + id) % MAP_CACHE_BUCKETS];
+}
 
-static pthread_mutex_t sMapLock = PTHREAD_MUTEX_INITIALIZER; 
+static mapping_t* findMappingLocked(const private_handle_t* hnd)
+{
+    mapping_t* m = *bucketFor(hnd->pid, hnd->id);
+    while (m && !(m->pid == hnd->pid && m->id == hnd->id &&
+            m->size == size_t(hnd->size))) {
+        m = m->hashNext;
+    }
+    return m;
+}
+
+static mapping_t* createMappingLocked(const private_handle_t* hnd, void* base,
+        const region_key_t* key)
+{
+    mapping_t* m = new mapping_t;
+    m->pid = hnd->pid;
+    m->id = hnd->id;
+    m->size = hnd->size;
+    if (key) {
+        m->key = *key;
+    } else {
+        memset(&m->key, 0, sizeof(m->key));
+    }
+    m->base = base;
+    m->refs = 1;
+    m->lruPrev = m->lruNext = NULL;
+    m->lockUsage = 0;
+    mapping_t** bucket = bucketFor(m->pid, m->id);
+    m->hashNext = *bucket;
+    *bucket = m;
+    return m;
+}
+
+/* removes <m> from the table, the caller gets its mapping */
+static void removeMappingLocked(mapping_t* m)
+{
+    mapping_t** p = bucketFor(m->pid, m->id);
+    while (*p != m)
+        p = &(*p)->hashNext;
+    *p = m->hashNext;
+}
+
+static void lruRemoveLocked(mapping_t* m)
+{
+    if (m->lruPrev) m->lruPrev->lruNext = m->lruNext;
+    else            sLruHead = m->lruNext;
+    if (m->lruNext) m->lruNext->lruPrev = m->lruPrev;
+    else            sLruTail = m->lruPrev;
+    m->lruPrev = m->lruNext = NULL;
+    sCachedBytes -= m->size;
+}
+
+static void lruAddLocked(mapping_t* m)
+{
+    m->lruPrev = NULL;
+    m->lruNext = sLruHead;
+    if (sLruHead) sLruHead->lruPrev = m;
+    else          sLruTail = m;
+    sLruHead = m;
+    sCachedBytes += m->size;
+}
+
+static void destroyMappingLocked(mapping_t* m)
+{
+    removeMappingLocked(m);
+    unmapRegion(m->base, m->size);
+    delete m;
+}
+
+static void trimCacheLocked()
+{
+    while (sCachedBytes > sCacheBudget) {
+        mapping_t* m = sLruTail;
+        lruRemoveLocked(m);
+        destroyMappingLocked(m);
+    }
+}
+
+static void initCacheLocked()
+{
+    if (sCacheInitialized)
+        return;
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.gralloc.map_cache", value, MAP_CACHE_DEFAULT_SIZE);
+    sCacheBudget = size_t(atoi(value)) * 1024;
+    sCacheInitialized = true;
+}
+
+static int mapBufferLocked(const private_handle_t* hnd, mapping_t** pMapping,
+        const region_key_t* key)
+{
+    void* base = mapRegion(hnd);
+    if (!base)
+        return -errno;
+    *pMapping = createMappingLocked(hnd, base, key);
+    return 0;
+}
 
 /*****************************************************************************/
 
@@ -93,11 +245,46 @@ int gralloc_register_buffer(gralloc_module_t const* module,
         return -EINVAL;
 
     // if this handle was created in this process, then we keep it as is.
+    // the framebuffer is already mapped by the module.
     int err = 0;
     private_handle_t* hnd = (private_handle_t*)handle;
-    if (hnd->pid != getpid()) {
-        void *vaddr;
-        err = gralloc_map(module, handle, &vaddr);
+    if (hnd->pid != getpid() &&
+            !(hnd->flags & private_handle_t::PRIV_FLAGS_FRAMEBUFFER)) {
+        region_key_t key;
+        err = getBufferRegionKey(hnd->fd, &key);
+        if (err < 0) {
+            LOGE("couldn't identify buffer %d of pid %d (%s)",
+                    hnd->id, hnd->pid, strerror(-err));
+            return err;
+        }
+        pthread_mutex_lock(&sMapLock);
+        initCacheLocked();
+        mapping_t* m = findMappingLocked(hnd);
+        if (m && memcmp(&m->key, &key, sizeof(key))) {
+            // another buffer with the same ints: the pid was reused,
+            // or the handle is forged
+            if (m->refs == 0) {
+                lruRemoveLocked(m);
+                destroyMappingLocked(m);
+                m = NULL;
+            } else {
+                LOGE("buffer %d of pid %d doesn't match its registered "
+                        "mapping", hnd->id, hnd->pid);
+                err = -EINVAL;
+            }
+        }
+        if (err == 0) {
+            if (m) {
+                if (m->refs++ == 0) {
+                    lruRemoveLocked(m);
+                    // whatever the last user was doing with it
+                    m->lockUsage = 0;
+                }
+            } else {
+                err = mapBufferLocked(hnd, &m, &key);
+            }
+        }
+        pthread_mutex_unlock(&sMapLock);
     }
     return err;
 }
@@ -111,9 +298,16 @@ int gralloc_unregister_buffer(gralloc_module_t const* module,
     // never unmap buffers that were created in this process
     private_handle_t* hnd = (private_handle_t*)handle;
     if (hnd->pid != getpid()) {
-        if (hnd->base) {
-            gralloc_unmap(module, handle);
+        pthread_mutex_lock(&sMapLock);
+        mapping_t* m = findMappingLocked(hnd);
+        if (m && m->refs > 0) {
+            // keep the mapping for the next time this buffer comes back
+            if (--m->refs == 0) {
+                lruAddLocked(m);
+                trimCacheLocked();
+            }
         }
+        pthread_mutex_unlock(&sMapLock);
     }
     return 0;
 }
@@ -121,19 +315,90 @@ int gralloc_unregister_buffer(gralloc_module_t const* module,
 int mapBuffer(gralloc_module_t const* module,
         private_handle_t* hnd)
 {
-    void* vaddr;
-    return gralloc_map(module, hnd, &vaddr);
+    int err = 0;
+    pthread_mutex_lock(&sMapLock);
+    mapping_t* m = findMappingLocked(hnd);
+    if (!m) {
+        err = mapBufferLocked(hnd, &m, NULL);
+    }
+    pthread_mutex_unlock(&sMapLock);
+    return err;
 }
 
-int terminateBuffer(gralloc_module_t const* module,
-        private_handle_t* hnd)
+void attachBuffer(private_handle_t const* hnd, void* base)
 {
-    if (hnd->base) {
-        // this buffer was mapped, unmap it now
-        gralloc_unmap(module, hnd);
+    pthread_mutex_lock(&sMapLock);
+    createMappingLocked(hnd, base, NULL);
+    pthread_mutex_unlock(&sMapLock);
+}
+
+void* detachBuffer(private_handle_t const* hnd)
+{
+    void* base = NULL;
+    pthread_mutex_lock(&sMapLock);
+    mapping_t* m = findMappingLocked(hnd);
+    if (m) {
+        removeMappingLocked(m);
+        base = m->base;
+        delete m;
     }
+    pthread_mutex_unlock(&sMapLock);
+    return base;
+}
 
-    return 0;
+/*****************************************************************************/
+
+/*
+ * ashmem is always mapped cacheable, so there is no uncached or
+ * write-combined view to hand out for the *_RARELY usages. What the usage
+ * bits decide instead is whether the CPU caches have to be maintained
+ * around a software access: only when the buffer is also accessed by
+ * hardware.
+ *
+ * The only way we have to maintain them to the point of coherency is the
+ * cache ioctls of vendor ashmem drivers. Without them, or for memfd
+ * buffers, nothing is done: the caches must be coherent with the devices,
+ * or the drivers of those devices must take care of it.
+ */
+
+// hardware that may write to a buffer, or read from it
+#define HW_WRITE_MASK   (GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_2D)
+#define HW_READ_MASK    (GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_2D | \
+                         GRALLOC_USAGE_HW_COMPOSER | GRALLOC_USAGE_HW_FB | \
+                         GRALLOC_USAGE_HW_VIDEO_ENCODER)
+
+enum {
+    // write dirty lines back to memory, before hardware reads it
+    CACHE_CLEAN,
+    // drop stale lines, before the CPU reads what hardware wrote
+    CACHE_INVALIDATE
+};
+
+static void cacheMaintenance(const private_handle_t* hnd, int op)
+{
+#if defined(ASHMEM_CACHE_CLEAN_RANGE) && defined(ASHMEM_CACHE_FLUSH_RANGE)
+    // these work on the whole region. A flush cleans as well, so that it
+    // can't discard lines another thread wrote outside of our range.
+    if (!(hnd->flags & private_handle_t::PRIV_FLAGS_HUGEPAGE)) {
+        int cmd = (op == CACHE_CLEAN) ? ASHMEM_CACHE_CLEAN_RANGE
+                                      : ASHMEM_CACHE_FLUSH_RANGE;
+        if (ioctl(hnd->fd, cmd, 0) < 0) {
+            LOGE("ashmem cache maintenance failed (%s)", strerror(errno));
+        }
+    }
+#endif
+    // __ARM_NR_cacheflush won't do: it only cleans to the point of
+    // unification, for the instruction cache
+}
+
+bool needsCacheMaintenance(int usage)
+{
+#if defined(ASHMEM_CACHE_CLEAN_RANGE) && defined(ASHMEM_CACHE_FLUSH_RANGE)
+    return ((usage & GRALLOC_USAGE_SW_READ_MASK) && (usage & HW_WRITE_MASK)) ||
+            ((usage & GRALLOC_USAGE_SW_WRITE_MASK) && (usage & HW_READ_MASK));
+#else
+    return false;
+#endif
 }
 
 int gralloc_lock(gralloc_module_t const* module,
@@ -142,28 +407,79 @@ int gralloc_lock(gralloc_module_t const* module,
         void** vaddr)
 {
     // this is called when a buffer is being locked for software
-    // access. in thin implementation we have nothing to do since
-    // not synchronization with the h/w is needed.
-    // typically this is used to wait for the h/w to finish with
-    // this buffer if relevant. the data cache may need to be
-    // flushed or invalidated depending on the usage bits and the
-    // hardware.
+    // access. typically this is used to wait for the h/w to finish with
+    // this buffer if relevant, here we only make sure the CPU sees what
+    // the h/w wrote.
 
     if (private_handle_t::validate(handle) < 0)
         return -EINVAL;
 
     private_handle_t* hnd = (private_handle_t*)handle;
-    *vaddr = (void*)hnd->base;
-    return 0;
+    if (hnd->flags & private_handle_t::PRIV_FLAGS_FRAMEBUFFER) {
+        private_module_t const* pm =
+                reinterpret_cast<private_module_t const*>(module);
+        *vaddr = pm->framebufferBase ?
+                (char*)pm->framebufferBase + hnd->offset : NULL;
+        return 0;
+    }
+
+    int err = 0;
+    pthread_mutex_lock(&sMapLock);
+    mapping_t* m = findMappingLocked(hnd);
+    if (m && m->refs == 0) {
+        // cached after its last unregister, only a handle that was
+        // registered again (and checked) may use it
+        m = NULL;
+        err = -EINVAL;
+    } else if (!m && hnd->pid == getpid()) {
+        // allocated without software usage, mapped the first time it's
+        // needed
+        err = mapBufferLocked(hnd, &m, NULL);
+    } else if (!m) {
+        // a remote buffer that was never registered
+        err = -EINVAL;
+    }
+    void* base = NULL;
+    if (m) {
+        m->lockUsage = usage;
+        base = m->base;
+    }
+    pthread_mutex_unlock(&sMapLock);
+
+    if (base && (usage & GRALLOC_USAGE_SW_READ_MASK) &&
+            (hnd->usage & HW_WRITE_MASK)) {
+        cacheMaintenance(hnd, CACHE_INVALIDATE);
+    }
+    *vaddr = base ? (char*)base + hnd->offset : NULL;
+    return err;
 }
 
-int gralloc_unlock(gralloc_module_t const* module, 
+int gralloc_unlock(gralloc_module_t const* module,
         buffer_handle_t handle)
 {
-    // we're done with a software buffer. nothing to do in this
-    // implementation. typically this is used to flush the data cache.
+    // we're done with a software buffer. if the h/w is going to read
+    // it, what we wrote must reach memory. the framebuffer is mapped
+    // write-combined by its driver and never needs it.
 
     if (private_handle_t::validate(handle) < 0)
         return -EINVAL;
+
+    private_handle_t* hnd = (private_handle_t*)handle;
+    if (hnd->flags & private_handle_t::PRIV_FLAGS_FRAMEBUFFER)
+        return 0;
+
+    int lockUsage = 0;
+    pthread_mutex_lock(&sMapLock);
+    mapping_t* m = findMappingLocked(hnd);
+    if (m) {
+        lockUsage = m->lockUsage;
+        m->lockUsage = 0;
+    }
+    pthread_mutex_unlock(&sMapLock);
+
+    if ((lockUsage & GRALLOC_USAGE_SW_WRITE_MASK) &&
+            (hnd->usage & HW_READ_MASK)) {
+        cacheMaintenance(hnd, CACHE_CLEAN);
+    }
     return 0;
 }
@@ -0,0 +1,194 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/mman.h>
+
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
+#include "gralloc_priv.h"
+#include "gr.h"
+
+/*****************************************************************************/
+
+/*
+ * When a buffer is freed, a new region of the same page-rounded size is
+ * created and mapped in its place, so that allocating a surface of a size
+ * that was just released is a list pop instead of ashmem_create_region() +
+ * mmap(). Surfaces come and go in the same few sizes.
+ *
+ * Freed buffers themselves are never reused: every process the handle was
+ * sent to may still hold its fd or a mapping of it. The regions in the
+ * pool were never handed out, and no page of them has been touched, so
+ * they only cost an fd and address space. The pool is bounded by
+ * debug.gralloc.pool_size (in KB, 0 disables it); going over the budget
+ * drops the least recently used size class first.
+ */
+
+// number of distinct sizes kept at the same time
+#define POOL_NUM_CLASSES    16
+
+// in KB
+#define POOL_DEFAULT_SIZE   "16384"
+
+struct pool_entry_t {
+    pool_entry_t* next;
+    int fd;
+    void* base;
+};
+
+struct pool_class_t {
+    size_t size;
+    pool_entry_t* head;
+    uint32_t lastUsed;
+};
+
+static pthread_mutex_t sPoolLock = PTHREAD_MUTEX_INITIALIZER;
+static pool_class_t sClasses[POOL_NUM_CLASSES];
+static bool sPoolInitialized = false;
+static size_t sPoolBudget;
+static size_t sPooledBytes;
+static uint32_t sPoolClock;
+
+/*****************************************************************************/
+
+static void destroyEntry(pool_entry_t* e, size_t size)
+{
+    if (munmap(e->base, size) < 0) {
+        LOGE("Could not unmap %s", strerror(errno));
+    }
+    close(e->fd);
+    delete e;
+}
+
+static void initPoolLocked()
+{
+    if (sPoolInitialized)
+        return;
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.gralloc.pool_size", value, POOL_DEFAULT_SIZE);
+    sPoolBudget = size_t(atoi(value)) * 1024;
+    sPoolInitialized = true;
+}
+
+/* drops one buffer from the least recently used class, false if empty */
+static bool evictLocked()
+{
+    pool_class_t* victim = NULL;
+    for (int i=0 ; i<POOL_NUM_CLASSES ; i++) {
+        pool_class_t* c = &sClasses[i];
+        if (c->head && (!victim || int32_t(c->lastUsed - victim->lastUsed) < 0))
+            victim = c;
+    }
+    if (!victim)
+        return false;
+    pool_entry_t* e = victim->head;
+    victim->head = e->next;
+    sPooledBytes -= victim->size;
+    destroyEntry(e, victim->size);
+    return true;
+}
+
+static pool_class_t* findClassLocked(size_t size, bool create)
+{
+    pool_class_t* empty = NULL;
+    for (int i=0 ; i<POOL_NUM_CLASSES ; i++) {
+        pool_class_t* c = &sClasses[i];
+        if (c->head && c->size == size)
+            return c;
+        if (!c->head && !empty)
+            empty = c;
+    }
+    if (!create)
+        return NULL;
+    if (!empty) {
+        // all classes are in use, recycle the coldest one
+        while (!empty) {
+            evictLocked();
+            for (int i=0 ; i<POOL_NUM_CLASSES && !empty ; i++) {
+                if (!sClasses[i].head)
+                    empty = &sClasses[i];
+            }
+        }
+    }
+    empty->size = size;
+    return empty;
+}
+
+/*****************************************************************************/
+
+int acquirePooledBuffer(size_t size, int* pFd, void** pBase)
+{
+    pthread_mutex_lock(&sPoolLock);
+    pool_class_t* c = findClassLocked(size, false);
+    pool_entry_t* e = NULL;
+    if (c) {
+        e = c->head;
+        c->head = e->next;
+        c->lastUsed = ++sPoolClock;
+        sPooledBytes -= size;
+    }
+    pthread_mutex_unlock(&sPoolLock);
+
+    if (!e)
+        return -ENOENT;
+
+    *pFd = e->fd;
+    *pBase = e->base;
+    delete e;
+    return 0;
+}
+
+void refillPool(size_t size)
+{
+    pthread_mutex_lock(&sPoolLock);
+    initPoolLocked();
+    const size_t budget = sPoolBudget;
+    pthread_mutex_unlock(&sPoolLock);
+    if (size > budget)
+        return;
+
+    pool_entry_t* e = new pool_entry_t;
+    e->fd = createBufferRegion(size);
+    if (e->fd < 0) {
+        delete e;
+        return;
+    }
+    e->base = mmap(0, size, PROT_READ|PROT_WRITE, MAP_SHARED, e->fd, 0);
+    if (e->base == MAP_FAILED) {
+        LOGE("couldn't map pooled buffer (%s)", strerror(errno));
+        close(e->fd);
+        delete e;
+        return;
+    }
+
+    pthread_mutex_lock(&sPoolLock);
+    while (sPooledBytes + size > sPoolBudget && evictLocked())
+        ;
+    pool_class_t* c = findClassLocked(size, true);
+    e->next = c->head;
+    c->head = e;
+    c->lastUsed = ++sPoolClock;
+    sPooledBytes += size;
+    pthread_mutex_unlock(&sPoolLock);
+}
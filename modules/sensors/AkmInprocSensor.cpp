@@ -0,0 +1,292 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/timerfd.h>
+
+#include <cutils/log.h>
+
+#include "AkmInprocSensor.h"
+
+/*****************************************************************************/
+
+/* from the AK8963 reference driver */
+#define AKM_DEVICE_NAME             "/dev/akm8963_dev"
+#define AKMIO                       0xA1
+#define ECS_IOCTL_READ              _IOWR(AKMIO, 0x01, char*)
+#define ECS_IOCTL_SET_MODE          _IOW(AKMIO, 0x03, short)
+#define ECS_IOCTL_GETDATA           _IOR(AKMIO, 0x04, char[8])
+
+#define AK8963_MODE_POWERDOWN       0x00
+#define AK8963_MODE_SNG_MEASURE     0x01
+#define AK8963_MODE_FUSE_ACCESS     0x0F
+#define AK8963_BIT_16               0x10
+#define AK8963_FUSE_ASAX            0x10
+#define AK8963_ST2_HOFL             0x08
+
+/* 16-bit output */
+#define AK8963_UT_PER_LSB           0.15f
+
+#define AKM_DEFAULT_INTERVAL        200000000LL
+
+/*****************************************************************************/
+
+AkmInprocSensor::AkmInprocSensor(CalibrationStore* store)
+    : SensorBase(AKM_DEVICE_NAME, NULL),
+      mTimerFd(-1),
+      mStore(store),
+      mOffsetStored(false)
+{
+	for (int i=0; i<numSensors; i++) {
+		mEnabled[i] = 0;
+		mDelay[i] = -1;
+	}
+    memset(mPendingEvents, 0, sizeof(mPendingEvents));
+
+    mPendingEvents[MagneticField].version = sizeof(sensors_event_t);
+    mPendingEvents[MagneticField].sensor = ID_M;
+    mPendingEvents[MagneticField].type = SENSOR_TYPE_MAGNETIC_FIELD;
+
+    mPendingEvents[Orientation  ].version = sizeof(sensors_event_t);
+    mPendingEvents[Orientation  ].sensor = ID_O;
+    mPendingEvents[Orientation  ].type = SENSOR_TYPE_ORIENTATION;
+
+    mSensitivity[0] = mSensitivity[1] = mSensitivity[2] = AK8963_UT_PER_LSB;
+
+    // start from where we were last time instead of from scratch
+    float offset[3];
+    if (mStore && mStore->getMag(offset)) {
+        mCalibration.setOffset(offset);
+    }
+
+    open_device();
+    if (dev_fd >= 0) {
+        readSensitivity();
+    }
+    mTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    LOGE_IF(mTimerFd<0, "AkmInprocSensor: timerfd_create failed (%s)",
+            strerror(errno));
+}
+
+AkmInprocSensor::~AkmInprocSensor()
+{
+    if (mTimerFd >= 0) {
+        close(mTimerFd);
+    }
+    if (dev_fd >= 0) {
+        short mode = AK8963_MODE_POWERDOWN;
+        ioctl(dev_fd, ECS_IOCTL_SET_MODE, &mode);
+    }
+}
+
+/*
+ * The per-axis sensitivity adjustment values are programmed in the fuse
+ * ROM at the factory; see the AK8963 datasheet.
+ */
+int AkmInprocSensor::readSensitivity()
+{
+    short mode = AK8963_MODE_FUSE_ACCESS;
+    if (ioctl(dev_fd, ECS_IOCTL_SET_MODE, &mode) < 0)
+        return -errno;
+
+    char buffer[4];
+    buffer[0] = 3;
+    buffer[1] = AK8963_FUSE_ASAX;
+    int err = ioctl(dev_fd, ECS_IOCTL_READ, buffer) < 0 ? -errno : 0;
+    if (err == 0) {
+        for (int i=0 ; i<3 ; i++) {
+            uint8_t asa = buffer[1 + i];
+            mSensitivity[i] = AK8963_UT_PER_LSB *
+                    ((asa - 128) * 0.5f / 128.0f + 1.0f);
+        }
+    }
+
+    mode = AK8963_MODE_POWERDOWN;
+    ioctl(dev_fd, ECS_IOCTL_SET_MODE, &mode);
+    return err;
+}
+
+int AkmInprocSensor::measure(float raw[3])
+{
+    short mode = AK8963_MODE_SNG_MEASURE | AK8963_BIT_16;
+    if (ioctl(dev_fd, ECS_IOCTL_SET_MODE, &mode) < 0)
+        return -errno;
+
+    // blocks until the measurement is done (~8ms)
+    char data[8];
+    if (ioctl(dev_fd, ECS_IOCTL_GETDATA, data) < 0)
+        return -errno;
+    if (data[7] & AK8963_ST2_HOFL) {
+        // magnetic sensor overflow, the value is meaningless
+        return -ERANGE;
+    }
+    for (int i=0 ; i<3 ; i++) {
+        int16_t v = (int16_t)(uint8_t(data[1 + 2*i]) |
+                (uint8_t(data[2 + 2*i]) << 8));
+        raw[i] = v * mSensitivity[i];
+    }
+    return 0;
+}
+
+int AkmInprocSensor::getFd() const
+{
+    return mTimerFd;
+}
+
+void AkmInprocSensor::updateTimer()
+{
+    int64_t period = -1;
+    for (int i=0 ; i<numSensors ; i++) {
+        if (mEnabled[i]) {
+            int64_t d = (mDelay[i] > 0) ? mDelay[i] : AKM_DEFAULT_INTERVAL;
+            if (period < 0 || d < period)
+                period = d;
+        }
+    }
+
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (period > 0) {
+        spec.it_interval.tv_sec  = period / 1000000000LL;
+        spec.it_interval.tv_nsec = period % 1000000000LL;
+        spec.it_value = spec.it_interval;
+    }
+    timerfd_settime(mTimerFd, 0, &spec, NULL);
+}
+
+int AkmInprocSensor::setEnable(int32_t handle, int enabled)
+{
+	int id = handle2id(handle);
+	if (id < 0)
+		return -EINVAL;
+
+	if (enabled) {
+		(mEnabled[id])++;
+		if (mEnabled[id] > 32767) mEnabled[id] = 32767;
+	} else {
+		(mEnabled[id])--;
+		if (mEnabled[id] < 0) mEnabled[id] = 0;
+	}
+	LOGD("AkmInprocSensor: mEnabled[%d] = %d", id, mEnabled[id]);
+
+	updateTimer();
+    return 0;
+}
+
+int AkmInprocSensor::setDelay(int32_t handle, int64_t ns)
+{
+	int id = handle2id(handle);
+	if (id < 0)
+		return -EINVAL;
+
+    if (ns < -1 || 2147483647 < ns) {
+		LOGE("AkmInprocSensor: invalid delay (%lld)", ns);
+        return -EINVAL;
+	}
+	mDelay[id] = ns;
+	updateTimer();
+    return 0;
+}
+
+int64_t AkmInprocSensor::getDelay(int32_t handle)
+{
+	int id = handle2id(handle);
+	return (id >= 0) ? mDelay[id] : 0;
+}
+
+int AkmInprocSensor::getEnable(int32_t handle)
+{
+	int id = handle2id(handle);
+	return (id >= 0) ? mEnabled[id] : 0;
+}
+
+int AkmInprocSensor::readEvents(sensors_event_t* data, int count)
+{
+    if (count < 1)
+        return -EINVAL;
+
+    uint64_t expirations;
+    if (read(mTimerFd, &expirations, sizeof(expirations)) < 0) {
+        return (errno == EAGAIN) ? 0 : -errno;
+    }
+
+    float raw[3];
+    int err = measure(raw);
+    if (err < 0) {
+        LOGE_IF(err != -ERANGE, "AkmInprocSensor: measure failed (%s)",
+                strerror(-err));
+        return 0;
+    }
+    const int64_t time = getTimestamp();
+
+    float mag[3];
+    mCalibration.addSample(raw, mag);
+    const int status = mCalibration.getAccuracy();
+    if (status == SENSOR_STATUS_ACCURACY_HIGH && mStore && !mOffsetStored) {
+        float offset[3];
+        mCalibration.getOffset(offset);
+        mStore->setMag(offset);
+        mOffsetStored = true;
+    }
+
+    int numEventReceived = 0;
+    if (mEnabled[MagneticField]) {
+        sensors_event_t& ev = mPendingEvents[MagneticField];
+        ev.magnetic.x = mag[0];
+        ev.magnetic.y = mag[1];
+        ev.magnetic.z = mag[2];
+        ev.magnetic.status = status;
+        ev.timestamp = time;
+        *data++ = ev;
+        count--;
+        numEventReceived++;
+    }
+    if (count && mEnabled[Orientation]) {
+        sensors_event_t& ev = mPendingEvents[Orientation];
+        if (mCalibration.getOrientation(mag, &ev.orientation.azimuth,
+                &ev.orientation.pitch, &ev.orientation.roll)) {
+            ev.orientation.status = status;
+            ev.timestamp = time;
+            *data++ = ev;
+            count--;
+            numEventReceived++;
+        }
+    }
+    return numEventReceived;
+}
+
+int AkmInprocSensor::setAccel(sensors_event_t* data)
+{
+    mCalibration.setAccel(data->data);
+	return 0;
+}
+
+int AkmInprocSensor::handle2id(int32_t handle)
+{
+    switch (handle) {
+        case ID_M:
+			return MagneticField;
+        case ID_O:
+			return Orientation;
+		default:
+			LOGE("AkmInprocSensor: unknown handle (%d)", handle);
+			return -EINVAL;
+    }
+}
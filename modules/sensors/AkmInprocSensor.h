@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AKM_INPROC_SENSOR_H
+#define ANDROID_AKM_INPROC_SENSOR_H
+
+#include <stdint.h>
+#include <errno.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include "sensors.h"
+#include "SensorBase.h"
+#include "CompassCalibration.h"
+#include "CalibrationStore.h"
+
+/*****************************************************************************/
+
+/*
+ * AK8963 driver that doesn't need AKMD: the chip is triggered and read
+ * directly through its character device at the requested rate, and
+ * calibration and orientation are computed in-process from the raw field
+ * and the accelerometer samples passed to setAccel().
+ */
+
+class AkmInprocSensor : public SensorBase {
+public:
+            AkmInprocSensor(CalibrationStore* store);
+    virtual ~AkmInprocSensor();
+
+    enum {
+        MagneticField= 0,
+        Orientation,
+        numSensors
+    };
+
+    virtual int readEvents(sensors_event_t* data, int count);
+    virtual int getFd() const;
+    virtual int setDelay(int32_t handle, int64_t ns);
+    virtual int setEnable(int32_t handle, int enabled);
+    virtual int64_t getDelay(int32_t handle);
+    virtual int getEnable(int32_t handle);
+	int setAccel(sensors_event_t* data);
+
+private:
+    int mEnabled[numSensors];
+	int64_t mDelay[numSensors];
+    int mTimerFd;
+    float mSensitivity[3];
+    CompassCalibration mCalibration;
+    CalibrationStore* mStore;
+    /* the offset is stored once per session, when first fully calibrated */
+    bool mOffsetStored;
+    sensors_event_t mPendingEvents[numSensors];
+
+	int handle2id(int32_t handle);
+    int readSensitivity();
+    int measure(float raw[3]);
+    void updateTimer();
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_AKM_INPROC_SENSOR_H
@@ -31,23 +31,30 @@
 
 /*****************************************************************************/
 
+const evdev_field AkmTraits::fields[] = {
+    { EVENT_TYPE_MAGV_X,        MagneticField,  EVDEV_SCALED,   0, CONVERT_M, 0 },
+    { EVENT_TYPE_MAGV_Y,        MagneticField,  EVDEV_SCALED,   1, CONVERT_M, 0 },
+    { EVENT_TYPE_MAGV_Z,        MagneticField,  EVDEV_SCALED,   2, CONVERT_M, 0 },
+    { EVENT_TYPE_MAGV_STATUS,   MagneticField,  EVDEV_STATUS,   0, 0,         0 },
+    { EVENT_TYPE_YAW,           Orientation,    EVDEV_SCALED,   0, CONVERT_O, 0 },
+    { EVENT_TYPE_PITCH,         Orientation,    EVDEV_SCALED,   1, CONVERT_O, 0 },
+    { EVENT_TYPE_ROLL,          Orientation,    EVDEV_SCALED,   2, CONVERT_O, 0 },
+    { EVENT_TYPE_ORIENT_STATUS, Orientation,    EVDEV_STATUS,   0, 0,         0 },
+};
+const int AkmTraits::numFields = ARRAY_SIZE(AkmTraits::fields);
+
 AkmSensor::AkmSensor()
-: SensorBase(NULL, "compass"),
-      mPendingMask(0),
-      mInputReader(32)
+: EvdevSensor<AkmTraits>(NULL, "compass", 32)
 {
 	for (int i=0; i<numSensors; i++) {
 		mEnabled[i] = 0;
 		mDelay[i] = -1;
 	}
-    memset(mPendingEvents, 0, sizeof(mPendingEvents));
 
-    mPendingEvents[MagneticField].version = sizeof(sensors_event_t);
     mPendingEvents[MagneticField].sensor = ID_M;
     mPendingEvents[MagneticField].type = SENSOR_TYPE_MAGNETIC_FIELD;
     mPendingEvents[MagneticField].magnetic.status = SENSOR_STATUS_ACCURACY_HIGH;
 
-    mPendingEvents[Orientation  ].version = sizeof(sensors_event_t);
     mPendingEvents[Orientation  ].sensor = ID_O;
     mPendingEvents[Orientation  ].type = SENSOR_TYPE_ORIENTATION;
     mPendingEvents[Orientation  ].orientation.status = SENSOR_STATUS_ACCURACY_HIGH;
@@ -169,7 +176,7 @@ int AkmSensor::setDelay(int32_t handle, int64_t ns)
 int64_t AkmSensor::getDelay(int32_t handle)
 {
 	int id = handle2id(handle);
-	if (id > 0) {
+	if (id >= 0) {
 		return mDelay[id];
 	} else {
 		return 0;
@@ -186,50 +193,9 @@ int AkmSensor::getEnable(int32_t handle)
 	}
 }
 
-int AkmSensor::readEvents(sensors_event_t* data, int count)
+bool AkmSensor::accept(int id)
 {
-    if (count < 1)
-        return -EINVAL;
-
-    ssize_t n = mInputReader.fill(data_fd);
-    if (n < 0)
-        return n;
-
-    int numEventReceived = 0;
-    input_event const* event;
-
-    while (count && mInputReader.readEvent(&event)) {
-        int type = event->type;
-        if (type == EV_ABS) {
-            processEvent(event->code, event->value);
-            mInputReader.next();
-        } else if (type == EV_SYN) {
-            int64_t time = timevalToNano(event->time);
-            for (int j=0 ; count && mPendingMask && j<numSensors ; j++) {
-                if (mPendingMask & (1<<j)) {
-                    mPendingMask &= ~(1<<j);
-                    mPendingEvents[j].timestamp = time;
-					//LOGD("data=%8.5f,%8.5f,%8.5f",
-						//mPendingEvents[j].data[0],
-						//mPendingEvents[j].data[1],
-						//mPendingEvents[j].data[2]);
-                    if (mEnabled[j]) {
-                        *data++ = mPendingEvents[j];
-                        count--;
-                        numEventReceived++;
-                    }
-                }
-            }
-            if (!mPendingMask) {
-                mInputReader.next();
-            }
-        } else {
-            LOGE("AkmSensor: unknown event (type=%d, code=%d)",
-                    type, event->code);
-            mInputReader.next();
-        }
-    }
-    return numEventReceived;
+    return mEnabled[id] > 0;
 }
 
 int AkmSensor::setAccel(sensors_event_t* data)
@@ -261,42 +227,3 @@ int AkmSensor::handle2id(int32_t handle)
 			return -EINVAL;
     }
 }
-
-void AkmSensor::processEvent(int code, int value)
-{
-    switch (code) {
-        case EVENT_TYPE_MAGV_X:
-            mPendingMask |= 1<<MagneticField;
-            mPendingEvents[MagneticField].magnetic.x = value * CONVERT_M;
-            break;
-        case EVENT_TYPE_MAGV_Y:
-            mPendingMask |= 1<<MagneticField;
-            mPendingEvents[MagneticField].magnetic.y = value * CONVERT_M;
-            break;
-        case EVENT_TYPE_MAGV_Z:
-            mPendingMask |= 1<<MagneticField;
-            mPendingEvents[MagneticField].magnetic.z = value * CONVERT_M;
-            break;
-        case EVENT_TYPE_MAGV_STATUS:
-            mPendingMask |= 1<<MagneticField;
-            mPendingEvents[MagneticField].magnetic.status = value;
-            break;
-
-        case EVENT_TYPE_YAW:
-            mPendingMask |= 1<<Orientation;
-            mPendingEvents[Orientation].orientation.azimuth = value * CONVERT_O;
-            break;
-        case EVENT_TYPE_PITCH:
-            mPendingMask |= 1<<Orientation;
-            mPendingEvents[Orientation].orientation.pitch = value * CONVERT_O;
-            break;
-        case EVENT_TYPE_ROLL:
-            mPendingMask |= 1<<Orientation;
-            mPendingEvents[Orientation].orientation.roll = value * CONVERT_O;
-            break;
-        case EVENT_TYPE_ORIENT_STATUS:
-            mPendingMask |= 1<<Orientation;
-            mPendingEvents[Orientation].orientation.status = value;
-            break;
-    }
-}
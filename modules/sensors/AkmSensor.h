@@ -24,25 +24,25 @@
 
 
 #include "sensors.h"
-#include "SensorBase.h"
-#include "InputEventReader.h"
+#include "EvdevSensor.h"
 
 /*****************************************************************************/
 
-struct input_event;
-
-class AkmSensor : public SensorBase {
-public:
-            AkmSensor();
-    virtual ~AkmSensor();
-
+struct AkmTraits {
     enum {
         MagneticField= 0,
         Orientation,
         numSensors
     };
+    static const evdev_field fields[];
+    static const int numFields;
+};
+
+class AkmSensor : public EvdevSensor<AkmTraits> {
+public:
+            AkmSensor();
+    virtual ~AkmSensor();
 
-    virtual int readEvents(sensors_event_t* data, int count);
     virtual int setDelay(int32_t handle, int64_t ns);
     virtual int setEnable(int32_t handle, int enabled);
     virtual int64_t getDelay(int32_t handle);
@@ -52,14 +52,11 @@ public:
 private:
     int mEnabled[numSensors];
 	int64_t mDelay[numSensors];
-    uint32_t mPendingMask;
-    InputEventCircularReader mInputReader;
-    sensors_event_t mPendingEvents[numSensors];
 	char input_sysfs_path[PATH_MAX];
 	int input_sysfs_path_len;
 
 	int handle2id(int32_t handle);
-    void processEvent(int code, int value);
+    virtual bool accept(int id);
 };
 
 /*****************************************************************************/
@@ -40,10 +40,24 @@ LOCAL_CFLAGS:= -DLOG_TAG=\"SensorHal\"
 LOCAL_SRC_FILES := \
 			SensorBase.cpp \
 			InputEventReader.cpp \
-			AkmSensor.cpp \
+			OnChangeFilter.cpp \
+			SensorFanout.cpp \
+			CalibrationStore.cpp \
+			SensorLog.cpp \
 			BmaSensor.cpp \
 			sensors.cpp
 
+# compass calibration and orientation in the HAL, without AKMD
+ifeq ($(BOARD_SENSORS_AKM_INPROC),true)
+LOCAL_CFLAGS += -DSENSORHAL_AKM_INPROC
+LOCAL_SRC_FILES += \
+			AkmInprocSensor.cpp \
+			CompassCalibration.cpp
+else
+LOCAL_SRC_FILES += \
+			AkmSensor.cpp
+endif
+
 ifeq ($(TARGET_PRODUCT), U8828D)
 LOCAL_CFLAGS += -DSENSORHAL_LIGHT_TSL -DSENSORHAL_ACC_BAMLIS3DH
 LOCAL_SRC_FILES += \
@@ -51,7 +65,14 @@ LOCAL_SRC_FILES += \
 else
 LOCAL_SRC_FILES += \
 			LightSensor31XX.cpp \
-			ProximitySensor.cpp 
+			ProximitySensor.cpp \
+			PolledSensor.cpp
+endif
+
+# lux attribute sampled when the light sensor has no input device,
+# ro.sensors.als.lux_path overrides it
+ifneq ($(BOARD_SENSORS_LIGHT_LUX_PATH),)
+LOCAL_CFLAGS += -DLIGHT_SYSFS_LUX_PATH=\"$(BOARD_SENSORS_LIGHT_LUX_PATH)\"
 endif
 
 
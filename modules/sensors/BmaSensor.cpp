@@ -22,6 +22,7 @@
 #include <dirent.h>
 #include <sys/select.h>
 #include <cutils/log.h>
+#include <cutils/properties.h>
 
 #include "BmaSensor.h"
 
@@ -45,19 +46,37 @@
 
 //#define BMA_UNIT_CONVERSION(value) ((value) * GRAVITY_EARTH / (720.0f))
 
+/* set to 1 to calibrate at the next enable, with the device lying flat */
+#define ACC_CALIBRATE_PROPERTY      "sensors.acc.calibrate"
+#define ACC_CALIBRATE_SAMPLES       32
+/* beyond this, the device wasn't flat or still (m/s^2) */
+#define ACC_CALIBRATE_MAX_OFFSET    (GRAVITY_EARTH * 0.2f)
+
 /*****************************************************************************/
 
-BmaSensor::BmaSensor()
-    : SensorBase(NULL, SENSOR_NAME),
+const evdev_field BmaTraits::fields[] = {
+#ifdef SENSORHAL_ACC_BAMLIS3DH
+    { EVENT_TYPE_ACCEL_X, Accelerometer, EVDEV_SCALED, 1, -CONVERTARG, 0 },
+    { EVENT_TYPE_ACCEL_Y, Accelerometer, EVDEV_SCALED, 0, -CONVERTARG, 0 },
+    { EVENT_TYPE_ACCEL_Z, Accelerometer, EVDEV_SCALED, 2,  CONVERTARG, 0 },
+#else
+    { EVENT_TYPE_ACCEL_X, Accelerometer, EVDEV_SCALED, 1,  CONVERT_Y,  0 },
+    { EVENT_TYPE_ACCEL_Y, Accelerometer, EVDEV_SCALED, 0,  CONVERT_X,  0 },
+    { EVENT_TYPE_ACCEL_Z, Accelerometer, EVDEV_SCALED, 2, -CONVERT_Z,  0 },
+#endif
+};
+const int BmaTraits::numFields = ARRAY_SIZE(BmaTraits::fields);
+
+BmaSensor::BmaSensor(CalibrationStore* store)
+    : EvdevSensor<BmaTraits>(NULL, SENSOR_NAME, 4),
       mEnabled(0),
       mDelay(-1),
-      mInputReader(4),
-      mHasPendingEvent(false)
+      mStore(store),
+      mCalSamples(-1)
 {
-    mPendingEvent.version = sizeof(sensors_event_t);
-    mPendingEvent.sensor = ID_A;
-    mPendingEvent.type = SENSOR_TYPE_ACCELEROMETER;
-    memset(mPendingEvent.data, 0, sizeof(mPendingEvent.data));
+    mPendingEvents[Accelerometer].sensor = ID_A;
+    mPendingEvents[Accelerometer].type = SENSOR_TYPE_ACCELEROMETER;
+    mPendingEvents[Accelerometer].acceleration.status = SENSOR_STATUS_ACCURACY_HIGH;
     if (data_fd >= 0) {
 	#ifdef SENSORHAL_ACC_BAMLIS3DH
         strcpy(input_sysfs_path, "/sys/bus/i2c/devices/1-0019/");
@@ -72,7 +91,11 @@ BmaSensor::BmaSensor()
 		input_sysfs_path[0] = '\0';
 		input_sysfs_path_len = 0;
 	}
-		
+
+    float offset[3];
+    if (mStore && mStore->getAccel(offset)) {
+        setOffset(Accelerometer, offset);
+    }
 }
 
 BmaSensor::~BmaSensor() {
@@ -82,38 +105,11 @@ BmaSensor::~BmaSensor() {
 }
 
 int BmaSensor::setInitialState() {
-    struct input_absinfo absinfo;
-
-	if (mEnabled) {
-	#ifdef SENSORHAL_ACC_BAMLIS3DH
-    	if (!ioctl(data_fd, EVIOCGABS(EVENT_TYPE_ACCEL_X), &absinfo)) {
-			mPendingEvent.acceleration.y = -(absinfo.value)*CONVERTARG;
-		}
-    	if (!ioctl(data_fd, EVIOCGABS(EVENT_TYPE_ACCEL_Y), &absinfo)) {
-			mPendingEvent.acceleration.x =-(absinfo.value)*CONVERTARG;
-		}
-		if (!ioctl(data_fd, EVIOCGABS(EVENT_TYPE_ACCEL_Z), &absinfo)) {
-			mPendingEvent.acceleration.z = (absinfo.value)*CONVERTARG;
-		}
-	#else
-	if (!ioctl(data_fd, EVIOCGABS(EVENT_TYPE_ACCEL_X), &absinfo)) {
-			mPendingEvent.acceleration.x = (absinfo.value)*CONVERT_Y;
-		}
-    	if (!ioctl(data_fd, EVIOCGABS(EVENT_TYPE_ACCEL_Y), &absinfo)) {
-			mPendingEvent.acceleration.x = (absinfo.value)*CONVERT_X;
-		}
-		if (!ioctl(data_fd, EVIOCGABS(EVENT_TYPE_ACCEL_Z), &absinfo)) {
-			mPendingEvent.acceleration.z = -(absinfo.value)*CONVERT_Z;
-		}
-	#endif
-	}
+    // report where we are right away, rather than on the first motion
+    readAbsState(1<<Accelerometer);
     return 0;
 }
 
-bool BmaSensor::hasPendingEvents() const {
-    return mHasPendingEvent;
-}
-
 int BmaSensor::setEnable(int32_t handle, int enabled) {
   
 	int err = 0;
@@ -137,7 +133,24 @@ int BmaSensor::setEnable(int32_t handle, int enabled) {
 			return err;
 		}
 		LOGD("BmaSensor: Control set %s", buffer);
-   		setInitialState();
+		if (buffer[0] == '1') {
+			char value[PROPERTY_VALUE_MAX];
+			property_get(ACC_CALIBRATE_PROPERTY, value, "0");
+			if (mStore && value[0] == '1') {
+				// work on raw readings until it's done
+				const float zero[3] = { 0, 0, 0 };
+				setOffset(Accelerometer, zero);
+				mCalSamples = 0;
+				mCalSum[0] = mCalSum[1] = mCalSum[2] = 0;
+			}
+			setInitialState();
+		} else if (mCalSamples >= 0) {
+			// turned off before the end, keep the previous offset
+			float offset[3];
+			mCalSamples = -1;
+			if (mStore->getAccel(offset))
+				setOffset(Accelerometer, offset);
+		}
     }
 
 	if (enabled) {
@@ -191,75 +204,54 @@ int BmaSensor::getEnable(int32_t handle)
 	return (handle == ID_A) ? mEnabled : 0;
 }
 
-int BmaSensor::readEvents(sensors_event_t* data, int count)
+/*
+ * Averages the first samples after enable and stores their difference
+ * to the 1g reading of a device lying flat, face up.
+ */
+void BmaSensor::calibrateSample()
 {
-    if (count < 1)
-        return -EINVAL;
+    const sensors_event_t& ev = mPendingEvents[Accelerometer];
+    float offset[3];
+    for (int i=0 ; i<3 ; i++)
+        mCalSum[i] += ev.data[i];
+    if (++mCalSamples < ACC_CALIBRATE_SAMPLES)
+        return;
 
-    if (mHasPendingEvent) {
-        mHasPendingEvent = false;
-        mPendingEvent.timestamp = getTimestamp();
-        *data = mPendingEvent;
-        return mEnabled ? 1 : 0;
+    const float expected[3] = { 0, 0, GRAVITY_EARTH };
+    bool valid = true;
+    for (int i=0 ; i<3 ; i++) {
+        offset[i] = mCalSum[i] / mCalSamples - expected[i];
+        if (fabsf(offset[i]) > ACC_CALIBRATE_MAX_OFFSET)
+            valid = false;
     }
-
-    ssize_t n = mInputReader.fill(data_fd);
-    if (n < 0)
-        return n;
-
-    int numEventReceived = 0;
-    input_event const* event;
-
-    while (count && mInputReader.readEvent(&event)) {
-        int type = event->type;
-        if (type == EV_ABS) {
-            float value = event->value;
-	    #ifdef SENSORHAL_ACC_BAMLIS3DH
-            if (event->code == EVENT_TYPE_ACCEL_X) {
-                mPendingEvent.acceleration.y= -(value)*CONVERTARG;
-            } else if (event->code == EVENT_TYPE_ACCEL_Y) {
-                mPendingEvent.acceleration.x=-(value)*CONVERTARG;
-            } else if (event->code == EVENT_TYPE_ACCEL_Z) {
-                mPendingEvent.acceleration.z = (value)*CONVERTARG;
-            }
-	    #else
-	    if (event->code == EVENT_TYPE_ACCEL_X) {
-                 mPendingEvent.acceleration.y = (value)*CONVERT_Y;
-            } else if (event->code == EVENT_TYPE_ACCEL_Y) {
-                 mPendingEvent.acceleration.x =(value)*CONVERT_X;
-            } else if (event->code == EVENT_TYPE_ACCEL_Z) {
-                  mPendingEvent.acceleration.z = -(value)*CONVERT_Z;
-            }
-	   #endif
-	//LOGE("bmasensor readEvents x: %d y: %d z:%d\n ",mPendingEvent.acceleration.x,mPendingEvent.acceleration.y,
-		//	mPendingEvent.acceleration.z);
-        } else if (type == EV_SYN) {
-            mPendingEvent.timestamp = timevalToNano(event->time);
-	     mPendingEvent.sensor = ID_A;
-	     mPendingEvent.type = SENSOR_TYPE_ACCELEROMETER;
-	     mPendingEvent.acceleration.status = SENSOR_STATUS_ACCURACY_HIGH;
-
-            if (mEnabled) {
-                *data++ = mPendingEvent;
-                count--;
-                numEventReceived++;
-            }
-        } else {
-            LOGE("BmaSensor: unknown event (type=%d, code=%d)",
-                    type, event->code);
-        }
-        mInputReader.next();
+    mCalSamples = -1;
+    if (!valid) {
+        LOGW("BmaSensor: calibration rejected (%f, %f, %f)",
+                offset[0], offset[1], offset[2]);
+        if (mStore->getAccel(offset))
+            setOffset(Accelerometer, offset);
+        return;
     }
+    LOGD("BmaSensor: calibrated (%f, %f, %f)", offset[0], offset[1], offset[2]);
+    setOffset(Accelerometer, offset);
+    mStore->setAccel(offset);
+    property_set(ACC_CALIBRATE_PROPERTY, "0");
+}
 
-    return numEventReceived;
+bool BmaSensor::accept(int id)
+{
+    if (mCalSamples >= 0)
+        calibrateSample();
+    return mEnabled > 0;
 }
+
 int BmaSensor::setAccel()
 {
 	int err;
 	int16_t acc[3];
-	acc[0] = (int16_t)(mPendingEvent.acceleration.x / GRAVITY_EARTH * AKSC_LSG);
-	acc[1] = (int16_t)(mPendingEvent.acceleration.y / GRAVITY_EARTH * AKSC_LSG);
-	acc[2] = (int16_t)(mPendingEvent.acceleration.z / GRAVITY_EARTH * AKSC_LSG);
+	acc[0] = (int16_t)(mPendingEvents[Accelerometer].acceleration.x / GRAVITY_EARTH * AKSC_LSG);
+	acc[1] = (int16_t)(mPendingEvents[Accelerometer].acceleration.y / GRAVITY_EARTH * AKSC_LSG);
+	acc[2] = (int16_t)(mPendingEvents[Accelerometer].acceleration.z / GRAVITY_EARTH * AKSC_LSG);
 	//strcpy(&input_sysfs_path[input_sysfs_path_len], "accel");
 	err = write_sys_attribute("/sys/class/compass/akm8963/accel", (char*)acc, 6);
 	/*if (err < 0) {
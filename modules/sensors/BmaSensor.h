@@ -23,29 +23,37 @@
 #include <sys/types.h>
 
 #include "sensors.h"
-#include "SensorBase.h"
-#include "InputEventReader.h"
+#include "EvdevSensor.h"
+#include "CalibrationStore.h"
 
 /*****************************************************************************/
 
-struct input_event;
+struct BmaTraits {
+    enum {
+        Accelerometer = 0,
+        numSensors
+    };
+    static const evdev_field fields[];
+    static const int numFields;
+};
 
-class BmaSensor : public SensorBase {
+class BmaSensor : public EvdevSensor<BmaTraits> {
     int mEnabled;
 	int64_t mDelay;
-    InputEventCircularReader mInputReader;
-    sensors_event_t mPendingEvent;
-    bool mHasPendingEvent;
     char input_sysfs_path[PATH_MAX];
     int input_sysfs_path_len;
+    CalibrationStore* mStore;
+    /* flat calibration in progress, see calibrateSample() */
+    int mCalSamples;
+    float mCalSum[3];
 
     int setInitialState();
+    virtual bool accept(int id);
+    void calibrateSample();
 
 public:
-            BmaSensor();
+            BmaSensor(CalibrationStore* store);
     virtual ~BmaSensor();
-    virtual int readEvents(sensors_event_t* data, int count);
-    virtual bool hasPendingEvents() const;
     virtual int setDelay(int32_t handle, int64_t ns);
     virtual int setEnable(int32_t handle, int enabled);
     virtual int64_t getDelay(int32_t handle);
@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cutils/log.h>
+
+#include "CalibrationStore.h"
+
+/*****************************************************************************/
+
+CalibrationStore::CalibrationStore(const char* path)
+    : mPath(path)
+{
+    memset(&mData, 0, sizeof(mData));
+    mData.magic = SENSORS_CALIBRATION_MAGIC;
+    mData.version = SENSORS_CALIBRATION_VERSION;
+    pthread_mutex_init(&mLock, NULL);
+    pthread_mutex_init(&mSaveLock, NULL);
+}
+
+CalibrationStore::~CalibrationStore()
+{
+    pthread_mutex_destroy(&mSaveLock);
+    pthread_mutex_destroy(&mLock);
+}
+
+int CalibrationStore::load()
+{
+    int fd = open(mPath, O_RDONLY);
+    if (fd < 0)
+        return -errno;
+
+    sensors_calibration cal;
+    ssize_t n = read(fd, &cal, sizeof(cal));
+    char extra;
+    if (n != sizeof(cal) || read(fd, &extra, 1) != 0) {
+        LOGW("CalibrationStore: ignoring %s (bad size)", mPath);
+        close(fd);
+        return -EINVAL;
+    }
+    close(fd);
+
+    if (cal.magic != SENSORS_CALIBRATION_MAGIC ||
+            cal.version != SENSORS_CALIBRATION_VERSION) {
+        LOGW("CalibrationStore: ignoring %s (bad header)", mPath);
+        return -EINVAL;
+    }
+    pthread_mutex_lock(&mLock);
+    mData = cal;
+    pthread_mutex_unlock(&mLock);
+    return 0;
+}
+
+/*
+ * Writes a new file next to the old one and renames it over, so that a
+ * crash or power loss leaves either the old or the new record. The record
+ * in memory keeps the new result even if this fails.
+ */
+int CalibrationStore::save()
+{
+    pthread_mutex_lock(&mSaveLock);
+    sensors_calibration cal;
+    pthread_mutex_lock(&mLock);
+    cal = mData;
+    pthread_mutex_unlock(&mLock);
+
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", mPath);
+
+    int err = 0;
+    int fd = open(tmp, O_WRONLY|O_CREAT|O_TRUNC, 0600);
+    if (fd < 0) {
+        err = -errno;
+        LOGE("CalibrationStore: couldn't create %s (%s)", tmp, strerror(-err));
+    } else {
+        if (write(fd, &cal, sizeof(cal)) != sizeof(cal) || fsync(fd) < 0)
+            err = -errno;
+        close(fd);
+        if (!err && rename(tmp, mPath) < 0)
+            err = -errno;
+        if (err) {
+            LOGE("CalibrationStore: couldn't save %s (%s)", mPath, strerror(-err));
+            unlink(tmp);
+        }
+    }
+    pthread_mutex_unlock(&mSaveLock);
+    return err;
+}
+
+bool CalibrationStore::getAccel(float offset[3]) const
+{
+    pthread_mutex_lock(&mLock);
+    const bool valid = (mData.valid & CALIBRATION_ACCEL) != 0;
+    if (valid)
+        memcpy(offset, mData.accel, sizeof(mData.accel));
+    pthread_mutex_unlock(&mLock);
+    return valid;
+}
+
+int CalibrationStore::setAccel(const float offset[3])
+{
+    pthread_mutex_lock(&mLock);
+    memcpy(mData.accel, offset, sizeof(mData.accel));
+    mData.valid |= CALIBRATION_ACCEL;
+    pthread_mutex_unlock(&mLock);
+    return save();
+}
+
+bool CalibrationStore::getMag(float offset[3]) const
+{
+    pthread_mutex_lock(&mLock);
+    const bool valid = (mData.valid & CALIBRATION_MAG) != 0;
+    if (valid)
+        memcpy(offset, mData.mag, sizeof(mData.mag));
+    pthread_mutex_unlock(&mLock);
+    return valid;
+}
+
+int CalibrationStore::setMag(const float offset[3])
+{
+    pthread_mutex_lock(&mLock);
+    memcpy(mData.mag, offset, sizeof(mData.mag));
+    mData.valid |= CALIBRATION_MAG;
+    pthread_mutex_unlock(&mLock);
+    return save();
+}
+
+bool CalibrationStore::getLightProx(void* data, size_t size) const
+{
+    pthread_mutex_lock(&mLock);
+    const bool valid = (mData.valid & CALIBRATION_LIGHT_PROX) &&
+            mData.light_prox_size == size;
+    if (valid)
+        memcpy(data, mData.light_prox, size);
+    pthread_mutex_unlock(&mLock);
+    return valid;
+}
+
+int CalibrationStore::setLightProx(const void* data, size_t size)
+{
+    if (size > sizeof(mData.light_prox))
+        return -EINVAL;
+
+    pthread_mutex_lock(&mLock);
+    memset(mData.light_prox, 0, sizeof(mData.light_prox));
+    memcpy(mData.light_prox, data, size);
+    mData.light_prox_size = size;
+    mData.valid |= CALIBRATION_LIGHT_PROX;
+    pthread_mutex_unlock(&mLock);
+    return save();
+}
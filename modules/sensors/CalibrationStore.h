@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_CALIBRATION_STORE_H
+#define ANDROID_CALIBRATION_STORE_H
+
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+/*****************************************************************************/
+
+/*
+ * Calibration results kept across boots in SENSORS_CALIBRATION_PATH, so
+ * that slow calibration procedures run once instead of at every open.
+ *
+ * The file is a single fixed-size record. It is read into memory when the
+ * HAL is opened, and rewritten as a whole (then renamed over the old one)
+ * whenever a driver stores a new result. The drivers only ever see the
+ * copy in memory, which the poll thread updates while binder threads
+ * read it.
+ */
+
+#define SENSORS_CALIBRATION_MAGIC       0x4c414353  /* "SCAL" */
+#define SENSORS_CALIBRATION_VERSION     1
+
+enum {
+    CALIBRATION_ACCEL       = 0x01,
+    CALIBRATION_MAG         = 0x02,
+    CALIBRATION_LIGHT_PROX  = 0x04
+};
+
+struct sensors_calibration {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t valid;
+    /* subtracted from the accelerometer, in m/s^2 */
+    float    accel[3];
+    /* hard-iron offset of the magnetometer, in uT */
+    float    mag[3];
+    /* chip-specific light and proximity settings */
+    uint32_t light_prox_size;
+    uint8_t  light_prox[64];
+};
+
+class CalibrationStore {
+    const char* mPath;
+    sensors_calibration mData;
+    mutable pthread_mutex_t mLock;
+    /* orders the writes of the file */
+    pthread_mutex_t mSaveLock;
+
+    int save();
+
+public:
+            CalibrationStore(const char* path);
+            ~CalibrationStore();
+
+    /* reads the stored record, 0 or -errno (-ENOENT before the first save) */
+    int load();
+
+    bool getAccel(float offset[3]) const;
+    int setAccel(const float offset[3]);
+
+    bool getMag(float offset[3]) const;
+    int setMag(const float offset[3]);
+
+    bool getLightProx(void* data, size_t size) const;
+    int setLightProx(const void* data, size_t size);
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_CALIBRATION_STORE_H
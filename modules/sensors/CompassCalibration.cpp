@@ -0,0 +1,243 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include <hardware/sensors.h>
+
+#include "CompassCalibration.h"
+
+/* a sample closer than this (uT) to the last one adds no information */
+#define MIN_SAMPLE_SPACING      5.0f
+/* weight left to the past at each new sample */
+#define FORGETTING_FACTOR       0.98
+/* samples needed before the first fit */
+#define MIN_FIT_SAMPLES         12
+/* plausible field strengths (uT) */
+#define MIN_FIELD               15.0f
+#define MAX_FIELD               100.0f
+/* span (in radii) an axis must cover before its scale is trusted */
+#define MIN_AXIS_SPAN           1.2f
+
+#define RAD2DEG                 (180.0f / M_PI)
+
+/*****************************************************************************/
+
+CompassCalibration::CompassCalibration()
+{
+    reset();
+}
+
+void CompassCalibration::reset()
+{
+    memset(mAtA, 0, sizeof(mAtA));
+    memset(mAtb, 0, sizeof(mAtb));
+    mSamples = 0;
+    mRadius = 0;
+    mAccuracy = SENSOR_STATUS_UNRELIABLE;
+    mHasAccel = false;
+    for (int i=0 ; i<3 ; i++) {
+        mLast[i] = 0;
+        mOffset[i] = 0;
+        mScale[i] = 1.0f;
+        mMin[i] = mMax[i] = 0;
+    }
+}
+
+void CompassCalibration::setOffset(const float offset[3])
+{
+    for (int i=0 ; i<3 ; i++)
+        mOffset[i] = offset[i];
+    // a known offset is good enough to start with
+    if (mAccuracy < SENSOR_STATUS_ACCURACY_LOW)
+        mAccuracy = SENSOR_STATUS_ACCURACY_LOW;
+}
+
+void CompassCalibration::getOffset(float offset[3]) const
+{
+    for (int i=0 ; i<3 ; i++)
+        offset[i] = mOffset[i];
+}
+
+/*
+ * Solves the normal equations of |x|^2 = 2 c.x + k for (c, k) by Gaussian
+ * elimination with partial pivoting; the radius is sqrt(k + |c|^2).
+ */
+bool CompassCalibration::solve(float center[3], float* radius) const
+{
+    double m[4][5];
+    for (int i=0 ; i<4 ; i++) {
+        for (int j=0 ; j<4 ; j++)
+            m[i][j] = mAtA[i][j];
+        m[i][4] = mAtb[i];
+    }
+    for (int col=0 ; col<4 ; col++) {
+        int pivot = col;
+        for (int row=col+1 ; row<4 ; row++) {
+            if (fabs(m[row][col]) > fabs(m[pivot][col]))
+                pivot = row;
+        }
+        if (fabs(m[pivot][col]) < 1e-9)
+            return false;
+        if (pivot != col) {
+            for (int j=0 ; j<5 ; j++) {
+                double t = m[col][j];
+                m[col][j] = m[pivot][j];
+                m[pivot][j] = t;
+            }
+        }
+        for (int row=0 ; row<4 ; row++) {
+            if (row == col)
+                continue;
+            double f = m[row][col] / m[col][col];
+            for (int j=col ; j<5 ; j++)
+                m[row][j] -= f * m[col][j];
+        }
+    }
+    double c[4];
+    for (int i=0 ; i<4 ; i++)
+        c[i] = m[i][4] / m[i][i];
+    double r2 = c[3] + c[0]*c[0] + c[1]*c[1] + c[2]*c[2];
+    if (r2 <= 0)
+        return false;
+    center[0] = c[0];
+    center[1] = c[1];
+    center[2] = c[2];
+    *radius = sqrt(r2);
+    return true;
+}
+
+void CompassCalibration::updateScale()
+{
+    float span[3];
+    float mean = 0;
+    for (int i=0 ; i<3 ; i++) {
+        span[i] = mMax[i] - mMin[i];
+        if (span[i] < MIN_AXIS_SPAN * mRadius) {
+            // not turned around this axis enough yet
+            return;
+        }
+        mean += span[i] / 3;
+    }
+    for (int i=0 ; i<3 ; i++) {
+        float s = mean / span[i];
+        // anything beyond that is not soft iron but a bad fit
+        if (s < 0.7f) s = 0.7f;
+        if (s > 1.3f) s = 1.3f;
+        mScale[i] = s;
+    }
+    mAccuracy = SENSOR_STATUS_ACCURACY_HIGH;
+}
+
+void CompassCalibration::addSample(const float raw[3], float calibrated[3])
+{
+    float dx = raw[0] - mLast[0];
+    float dy = raw[1] - mLast[1];
+    float dz = raw[2] - mLast[2];
+    if (!mSamples || dx*dx + dy*dy + dz*dz >
+            MIN_SAMPLE_SPACING * MIN_SAMPLE_SPACING) {
+        const double a[4] = { 2*raw[0], 2*raw[1], 2*raw[2], 1 };
+        const double b = raw[0]*raw[0] + raw[1]*raw[1] + raw[2]*raw[2];
+        for (int i=0 ; i<4 ; i++) {
+            for (int j=0 ; j<4 ; j++)
+                mAtA[i][j] = mAtA[i][j] * FORGETTING_FACTOR + a[i] * a[j];
+            mAtb[i] = mAtb[i] * FORGETTING_FACTOR + a[i] * b;
+        }
+        mLast[0] = raw[0];
+        mLast[1] = raw[1];
+        mLast[2] = raw[2];
+        mSamples++;
+
+        float center[3];
+        float radius;
+        if (mSamples >= MIN_FIT_SAMPLES && solve(center, &radius) &&
+                radius > MIN_FIELD && radius < MAX_FIELD) {
+            float shift = 0;
+            for (int i=0 ; i<3 ; i++) {
+                shift += fabsf(center[i] - mOffset[i]);
+                mOffset[i] = center[i];
+            }
+            if (shift > radius * 0.25f || mRadius == 0) {
+                // a new environment: the spans seen so far are stale
+                for (int i=0 ; i<3 ; i++)
+                    mMin[i] = mMax[i] = raw[i] - mOffset[i];
+                mScale[0] = mScale[1] = mScale[2] = 1.0f;
+                mAccuracy = SENSOR_STATUS_ACCURACY_MEDIUM;
+            }
+            mRadius = radius;
+        }
+        if (mRadius > 0) {
+            for (int i=0 ; i<3 ; i++) {
+                float v = raw[i] - mOffset[i];
+                if (v < mMin[i]) mMin[i] = v;
+                if (v > mMax[i]) mMax[i] = v;
+            }
+            if (mAccuracy < SENSOR_STATUS_ACCURACY_HIGH)
+                updateScale();
+        }
+    }
+
+    for (int i=0 ; i<3 ; i++)
+        calibrated[i] = (raw[i] - mOffset[i]) * mScale[i];
+}
+
+void CompassCalibration::setAccel(const float accel[3])
+{
+    mAccel[0] = accel[0];
+    mAccel[1] = accel[1];
+    mAccel[2] = accel[2];
+    mHasAccel = true;
+}
+
+/*
+ * Same conventions as the legacy orientation sensor: azimuth in [0, 360)
+ * from magnetic north, pitch in [-180, 180] around x, roll in [-90, 90]
+ * around y.
+ */
+bool CompassCalibration::getOrientation(const float mag[3],
+        float* azimuth, float* pitch, float* roll) const
+{
+    if (!mHasAccel)
+        return false;
+
+    const float* A = mAccel;
+    const float* E = mag;
+    // H = E x A points east
+    float Hx = E[1]*A[2] - E[2]*A[1];
+    float Hy = E[2]*A[0] - E[0]*A[2];
+    float Hz = E[0]*A[1] - E[1]*A[0];
+    float normH = sqrtf(Hx*Hx + Hy*Hy + Hz*Hz);
+    float normA = sqrtf(A[0]*A[0] + A[1]*A[1] + A[2]*A[2]);
+    if (normH < 0.1f || normA < 0.1f) {
+        // free fall, or the field is parallel to gravity
+        return false;
+    }
+    Hx /= normH; Hy /= normH; Hz /= normH;
+    const float Ax = A[0] / normA;
+    const float Ay = A[1] / normA;
+    const float Az = A[2] / normA;
+    // M = A x H points north
+    const float My = Az*Hx - Ax*Hz;
+
+    float az = atan2f(Hy, My) * RAD2DEG;
+    if (az < 0)
+        az += 360.0f;
+    *azimuth = az;
+    *pitch = atan2f(-Ay, Az) * RAD2DEG;
+    *roll = asinf(Ax) * RAD2DEG;
+    return true;
+}
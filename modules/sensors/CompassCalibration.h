@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_COMPASS_CALIBRATION_H
+#define ANDROID_COMPASS_CALIBRATION_H
+
+#include <stdint.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+/*****************************************************************************/
+
+/*
+ * Magnetometer calibration and tilt-compensated orientation, computed in
+ * the HAL instead of by AKMD.
+ *
+ * The hard-iron offset is the center of a sphere fitted by least squares
+ * to well-spread raw samples, with exponential forgetting so it follows
+ * slow changes of the magnetic environment. The soft-iron distortion is
+ * approximated by a per-axis scale that makes the spans of the three
+ * axes equal, once the device has been turned around enough to see them.
+ */
+
+class CompassCalibration {
+    double mAtA[4][4];
+    double mAtb[4];
+    int mSamples;
+    float mLast[3];
+    float mOffset[3];
+    float mScale[3];
+    float mMin[3];
+    float mMax[3];
+    float mRadius;
+    int mAccuracy;
+    float mAccel[3];
+    bool mHasAccel;
+
+    bool solve(float center[3], float* radius) const;
+    void updateScale();
+
+public:
+            CompassCalibration();
+    void reset();
+
+    /* hard-iron offset, in uT */
+    void setOffset(const float offset[3]);
+    void getOffset(float offset[3]) const;
+
+    /* feeds a raw sample in uT and returns it calibrated */
+    void addSample(const float raw[3], float calibrated[3]);
+    /* SENSOR_STATUS_* */
+    int getAccuracy() const { return mAccuracy; }
+
+    /* latest acceleration in m/s^2, device coordinates */
+    void setAccel(const float accel[3]);
+    /* orientation in degrees, false until both vectors are known */
+    bool getOrientation(const float mag[3],
+            float* azimuth, float* pitch, float* roll) const;
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_COMPASS_CALIBRATION_H
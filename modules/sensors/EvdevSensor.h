@@ -0,0 +1,297 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_EVDEV_SENSOR_H
+#define ANDROID_EVDEV_SENSOR_H
+
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+#include <sys/ioctl.h>
+
+#include <cutils/log.h>
+
+#include "sensors.h"
+#include "SensorBase.h"
+#include "InputEventReader.h"
+
+/*****************************************************************************/
+
+#ifndef SYN_DROPPED
+#define SYN_DROPPED     3
+#endif
+
+/*
+ * Common input event decoding for the drivers whose kernel side reports
+ * EV_ABS values followed by EV_SYN.
+ *
+ * A driver only describes how each ABS code maps onto its events, in a
+ * table of evdev_field. The table is turned into a per-code lookup once
+ * per instantiation, so decoding an event is one indexed load and a
+ * store, whatever the number of codes.
+ */
+
+enum {
+    /* data[slot] = value * scale */
+    EVDEV_SCALED    = 0,
+    /* the status byte of a sensors_vec_t */
+    EVDEV_STATUS,
+    /* data[slot] = (value > threshold) ? scale : 0 */
+    EVDEV_BINARY,
+    /* data[slot] = (value > threshold) ? 0 : scale */
+    EVDEV_BINARY_INV
+};
+
+struct evdev_field {
+    int     code;
+    int     sensor;
+    int     kind;
+    /* 0 to 2 */
+    int     slot;
+    float   scale;
+    int     threshold;
+};
+
+/*
+ * Traits must provide:
+ *   enum { ..., numSensors };
+ *   static const evdev_field fields[];
+ *   static const int numFields;
+ * Its enumerators are visible in the driver, which derives from it.
+ */
+template <class Traits>
+class EvdevSensor : public SensorBase, protected Traits {
+public:
+    virtual int readEvents(sensors_event_t* data, int count);
+    virtual bool hasPendingEvents() const;
+    virtual int getReportSize() const;
+
+protected:
+            EvdevSensor(const char* dev_name, const char* data_name,
+                    size_t numEvents);
+
+    /* whether a completed event of sensor <id> should be reported */
+    virtual bool accept(int id) = 0;
+
+    /* queues the current state of the sensors in <mask> for the next read */
+    void readAbsState(uint32_t mask);
+
+    /* calibration offset, subtracted from the EVDEV_SCALED values */
+    void setOffset(int id, const float offset[3]);
+
+    uint32_t mPendingMask;
+    bool mHasPendingEvent;
+    InputEventCircularReader mInputReader;
+    sensors_event_t mPendingEvents[Traits::numSensors];
+
+private:
+    float mOffsets[Traits::numSensors][3];
+    /* between a SYN_DROPPED and the next report */
+    bool mDropping;
+
+    static int8_t sCodeMap[ABS_MAX + 1];
+    static bool sCodeMapReady;
+
+    void decode(const evdev_field& f, int value);
+    int flushPending(sensors_event_t* data, int count, int64_t time);
+    void resync();
+};
+
+template <class Traits>
+int8_t EvdevSensor<Traits>::sCodeMap[ABS_MAX + 1];
+
+template <class Traits>
+bool EvdevSensor<Traits>::sCodeMapReady = false;
+
+template <class Traits>
+EvdevSensor<Traits>::EvdevSensor(const char* dev_name, const char* data_name,
+        size_t numEvents)
+    : SensorBase(dev_name, data_name),
+      mPendingMask(0),
+      mHasPendingEvent(false),
+      mInputReader(numEvents),
+      mDropping(false)
+{
+    // all drivers are created by open_sensors(), from a single thread
+    if (!sCodeMapReady) {
+        memset(sCodeMap, -1, sizeof(sCodeMap));
+        for (int i=0 ; i<Traits::numFields ; i++)
+            sCodeMap[Traits::fields[i].code] = i;
+        sCodeMapReady = true;
+    }
+    memset(mPendingEvents, 0, sizeof(mPendingEvents));
+    memset(mOffsets, 0, sizeof(mOffsets));
+    for (int i=0 ; i<Traits::numSensors ; i++)
+        mPendingEvents[i].version = sizeof(sensors_event_t);
+}
+
+template <class Traits>
+inline void EvdevSensor<Traits>::decode(const evdev_field& f, int value)
+{
+    sensors_event_t& ev = mPendingEvents[f.sensor];
+    switch (f.kind) {
+        case EVDEV_SCALED:
+            ev.data[f.slot] = value * f.scale - mOffsets[f.sensor][f.slot];
+            break;
+        case EVDEV_STATUS:
+            // same place for all the sensors_vec_t of the union
+            ev.magnetic.status = value;
+            break;
+        case EVDEV_BINARY:
+            ev.data[f.slot] = (value > f.threshold) ? f.scale : 0;
+            break;
+        case EVDEV_BINARY_INV:
+            ev.data[f.slot] = (value > f.threshold) ? 0 : f.scale;
+            break;
+    }
+    mPendingMask |= 1<<f.sensor;
+}
+
+template <class Traits>
+int EvdevSensor<Traits>::flushPending(sensors_event_t* data, int count,
+        int64_t time)
+{
+    int numEventReceived = 0;
+    while (count && mPendingMask) {
+        const int j = __builtin_ctz(mPendingMask);
+        mPendingMask &= mPendingMask - 1;
+        if (time)
+            mPendingEvents[j].timestamp = time;
+        if (accept(j)) {
+            *data++ = mPendingEvents[j];
+            count--;
+            numEventReceived++;
+        }
+    }
+    return numEventReceived;
+}
+
+template <class Traits>
+void EvdevSensor<Traits>::readAbsState(uint32_t mask)
+{
+    struct input_absinfo absinfo;
+    const int64_t time = getTimestamp();
+    for (int i=0 ; i<Traits::numFields ; i++) {
+        const evdev_field& f = Traits::fields[i];
+        if ((mask & (1<<f.sensor)) &&
+                !ioctl(data_fd, EVIOCGABS(f.code), &absinfo)) {
+            decode(f, absinfo.value);
+            mPendingEvents[f.sensor].timestamp = time;
+            mHasPendingEvent = true;
+        }
+    }
+}
+
+/*
+ * Reloads the decoded state from the device after events were dropped,
+ * without reporting it: the changes lost with them have no timestamp.
+ */
+template <class Traits>
+void EvdevSensor<Traits>::resync()
+{
+    struct input_absinfo absinfo;
+    for (int i=0 ; i<Traits::numFields ; i++) {
+        const evdev_field& f = Traits::fields[i];
+        if (!ioctl(data_fd, EVIOCGABS(f.code), &absinfo))
+            decode(f, absinfo.value);
+    }
+    mPendingMask = 0;
+}
+
+template <class Traits>
+void EvdevSensor<Traits>::setOffset(int id, const float offset[3])
+{
+    mOffsets[id][0] = offset[0];
+    mOffsets[id][1] = offset[1];
+    mOffsets[id][2] = offset[2];
+}
+
+template <class Traits>
+bool EvdevSensor<Traits>::hasPendingEvents() const
+{
+    return mHasPendingEvent;
+}
+
+template <class Traits>
+int EvdevSensor<Traits>::getReportSize() const
+{
+    // every code changed, and the EV_SYN
+    return Traits::numFields + 1;
+}
+
+template <class Traits>
+int EvdevSensor<Traits>::readEvents(sensors_event_t* data, int count)
+{
+    if (count < 1)
+        return -EINVAL;
+
+    if (mHasPendingEvent) {
+        // queued by readAbsState(), and already timestamped
+        int nb = flushPending(data, count, 0);
+        mHasPendingEvent = (mPendingMask != 0);
+        return nb;
+    }
+
+    input_event const* event;
+    if (!mInputReader.readEvent(&event)) {
+        // leftovers from a short read come first; the fd may well be
+        // empty then, and it is blocking
+        ssize_t n = mInputReader.fill(data_fd);
+        if (n < 0)
+            return n;
+    }
+
+    int numEventReceived = 0;
+
+    while (count && mInputReader.readEvent(&event)) {
+        const int type = event->type;
+        if (type == EV_ABS) {
+            const int code = event->code;
+            const int f = (code <= ABS_MAX) ? sCodeMap[code] : -1;
+            if (f >= 0 && !mDropping)
+                decode(Traits::fields[f], event->value);
+        } else if (type == EV_SYN && event->code == SYN_DROPPED) {
+            // the client buffer overflowed: the report in progress is
+            // incomplete, and so is everything up to the next one
+            LOGW("%s: input events dropped", data_name);
+            mPendingMask = 0;
+            mDropping = true;
+        } else if (type == EV_SYN && mDropping) {
+            resync();
+            mDropping = false;
+        } else if (type == EV_SYN) {
+            int nb = flushPending(data, count, getInputTimestamp(event->time));
+            data += nb;
+            count -= nb;
+            numEventReceived += nb;
+            if (mPendingMask) {
+                // out of room, finish this report on the next read
+                break;
+            }
+        } else {
+            LOGE("%s: unknown event (type=%d, code=%d)",
+                    data_name, type, event->code);
+        }
+        mInputReader.next();
+    }
+    return numEventReceived;
+}
+
+/*****************************************************************************/
+
+#endif  // ANDROID_EVDEV_SENSOR_H
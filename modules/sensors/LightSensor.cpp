@@ -24,21 +24,21 @@
 #define SENSOR_NAME     "ltr558"
 /*****************************************************************************/
 
+const evdev_field Ltr558Traits::fields[] = {
+    { ABS_DISTANCE, Proximity, EVDEV_BINARY_INV, 0, 5.0f, 2 },
+    { ABS_MISC,     Light,     EVDEV_SCALED,     0, 1.0f, 0 },
+};
+const int Ltr558Traits::numFields = ARRAY_SIZE(Ltr558Traits::fields);
+
 LightSensor::LightSensor()
-    : SensorBase(NULL, SENSOR_NAME),
-      mPendingMask(0),
-      mInputReader(4),
-      mHasPendingEvent(false)
+    : EvdevSensor<Ltr558Traits>(NULL, SENSOR_NAME, 4)
 {
-    memset(mPendingEvents, 0, sizeof(mPendingEvents));
 	for (int i=0; i<numSensors; i++) {
 		mEnabled[i] = 0;
 	}
-    mPendingEvents[Light].version = sizeof(sensors_event_t);
     mPendingEvents[Light].sensor = ID_L;
     mPendingEvents[Light].type = SENSOR_TYPE_LIGHT;
 
-    mPendingEvents[Proximity].version = sizeof(sensors_event_t);
     mPendingEvents[Proximity].sensor = ID_P;
     mPendingEvents[Proximity].type = SENSOR_TYPE_PROXIMITY;
     if (data_fd >= 0) {
@@ -85,6 +85,10 @@ int LightSensor::setEnable(int32_t handle, int enabled)
 
 	if (mEnabled[id] <= 0) {
 		if(enabled) buffer[0] = '1';
+		if (id == Light)
+			mLightFilter.reset();
+		else
+			mProximityFilter.reset();
 	} else if (mEnabled[id] == 1) {
 		if(!enabled) buffer[0] = '0';
 	}
@@ -110,79 +114,13 @@ int LightSensor::setEnable(int32_t handle, int enabled)
     return err;
 }
 
-bool LightSensor::hasPendingEvents() const
-{
-    return mHasPendingEvent;
-}
-
-int LightSensor::readEvents(sensors_event_t* data, int count)
+bool LightSensor::accept(int id)
 {
-    LOGD("LightSensor::readEvents count = %d", count);
-
-     if (count < 1)
-        return -EINVAL;
-
-    ssize_t n = mInputReader.fill(data_fd);
-    if (n < 0)
-        return n;
-
-    int numEventReceived = 0;
-    input_event const* event;
-
-    while (count && mInputReader.readEvent(&event)) {
-        int type = event->type;
-        if (type == EV_ABS) {
-            processEvent(event->code, event->value);
-            mInputReader.next();
-        } else if (type == EV_SYN) {
-            int64_t time = timevalToNano(event->time);
-            for (int j=0 ; count && mPendingMask && j<numSensors ; j++) {
-                if (mPendingMask & (1<<j)) {
-                    mPendingMask &= ~(1<<j);
-                    mPendingEvents[j].timestamp = time;
-					//LOGD("data=%8.5f,%8.5f,%8.5f",
-						//mPendingEvents[j].data[0],
-						//mPendingEvents[j].data[1],
-						//mPendingEvents[j].data[2]);
-                    if (mEnabled[j]) {
-                        *data++ = mPendingEvents[j];
-                        count--;
-                        numEventReceived++;
-                    }
-                }
-            }
-            if (!mPendingMask) {
-                mInputReader.next();
-            }
-        } else {
-            LOGE("AkmSensor: unknown event (type=%d, code=%d)",
-                    type, event->code);
-            mInputReader.next();
-        }
-    }
-    return numEventReceived;
-}
-
-void LightSensor::processEvent(int code, int value)
-{       
-   switch (code) {		
-   	case ABS_DISTANCE:               
-		mPendingEvents[Proximity].version = sizeof(sensors_event_t);                
-		mPendingEvents[Proximity].sensor = ID_P;                
-		mPendingEvents[Proximity].type = SENSOR_TYPE_PROXIMITY;               
-		memset(mPendingEvents[Proximity].data, 0, sizeof(mPendingEvents[Proximity].data));				             
-		mPendingEvents[Proximity].distance = (value > 2) ? 0 : 5;				
-		break;		
-	case ABS_MISC:                
-		mPendingEvents[Light].version = sizeof(sensors_event_t);                
-		mPendingEvents[Light].sensor = ID_L;               
-		mPendingEvents[Light].type = SENSOR_TYPE_LIGHT;                
-		memset(mPendingEvents[Light].data, 0, sizeof(mPendingEvents[Light].data));                
-		mPendingEvents[Light].light = value;			
-		break;            
-	default:	
-		break;	  
-	}
+    if (!mEnabled[id])
+        return false;
+    if (id == Light)
+        return mLightFilter.update(mPendingEvents[Light].light);
+    return mProximityFilter.update(mPendingEvents[Proximity].distance);
 }
 
 int LightSensor::setDelay(int32_t handle, int64_t ns)
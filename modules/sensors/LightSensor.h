@@ -18,44 +18,42 @@
 #define ANDROID_LIGHT_SENSOR_H
 
 #include "sensors.h"
-#include "SensorBase.h"
-#include "InputEventReader.h"
+#include "EvdevSensor.h"
+#include "OnChangeFilter.h"
 
 /*****************************************************************************/
 
-struct input_event;
+struct Ltr558Traits {
+    enum {
+        Light       = 0,
+        Proximity   = 1,
+        numSensors
+    };
+    static const evdev_field fields[];
+    static const int numFields;
+};
 
-class LightSensor : public SensorBase {
+class LightSensor : public EvdevSensor<Ltr558Traits> {
 public:
             LightSensor();
     virtual ~LightSensor();
-    virtual int readEvents(sensors_event_t* data, int count);
   //  virtual bool hasPendingEvents() const;
     //virtual int enable(int32_t handle, int enabled);
-    virtual bool hasPendingEvents() const;
     virtual int setDelay(int32_t handle, int64_t ns);
     virtual int setEnable(int32_t handle, int enabled);
     virtual int64_t getDelay(int32_t handle);
     virtual int getEnable(int32_t handle);
      int setInitialState();
 private:
-    enum {
-        Light       = 0,
-        Proximity   = 1,
-        numSensors
-    };
-
     int mEnabled[numSensors];
-    uint32_t mPendingMask;
-    InputEventCircularReader mInputReader;
-    sensors_event_t mPendingEvents[numSensors];
-    bool mHasPendingEvent;
     char input_sysfs_path[256];
     int input_sysfs_path_len;
     int alsEnabled;
     int psEnabled;
+    LightHysteresis mLightFilter;
+    ProximityDebounce mProximityFilter;
 
-    void processEvent(int code, int value);
+    virtual bool accept(int id);
    int handle2id(int32_t handle);
    
 
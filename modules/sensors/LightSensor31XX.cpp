@@ -25,17 +25,17 @@
 #define als_enable_bin_path             "/sys/devices/platform/stk-oss/als_enable"
 /*****************************************************************************/
 
+const evdev_field Light31XXTraits::fields[] = {
+    { EVENT_TYPE_LIGHT, Light, EVDEV_SCALED, 0, 1.0f, 0 },
+};
+const int Light31XXTraits::numFields = ARRAY_SIZE(Light31XXTraits::fields);
+
 LightSensor::LightSensor()
-    : SensorBase(NULL, SENSOR_NAME),
-      mPendingMask(0),
-      mInputReader(4),
-      mHasPendingEvent(false)
+    : EvdevSensor<Light31XXTraits>(NULL, SENSOR_NAME, 4)
 {
-    memset(mPendingEvents.data, 0, sizeof(mPendingEvents.data));
     mEnabled=0;
-    mPendingEvents.version = sizeof(sensors_event_t);
-    mPendingEvents.sensor = ID_L;
-    mPendingEvents.type = SENSOR_TYPE_LIGHT;
+    mPendingEvents[Light].sensor = ID_L;
+    mPendingEvents[Light].type = SENSOR_TYPE_LIGHT;
     int fd = open(als_enable_bin_path,O_RDONLY);
 
     if (fd>=0)
@@ -64,13 +64,8 @@ LightSensor::~LightSensor()
 }
 
 int LightSensor::setInitialState() {   
-    struct input_absinfo absinfo;
-    if (!ioctl(data_fd, EVIOCGABS(EVENT_TYPE_LIGHT), &absinfo)) {
-        mPendingEvents.light = (float)absinfo.value;
-        mHasPendingEvent = true;
-    }
-	else
-		LOGE("%s:ioctl failed!", __func__);		
+    readAbsState(1<<Light);
+    LOGE_IF(!mHasPendingEvent, "%s:ioctl failed!", __func__);
     return 0;
 }
 int LightSensor::setEnable(int32_t handle, int enabled)
@@ -90,8 +85,10 @@ int LightSensor::setEnable(int32_t handle, int enabled)
 			}			
             mEnabled = bEnable;
             err = 0;
-            if (mEnabled)
+            if (mEnabled) {
+                mFilter.reset();
                 setInitialState();
+            }
             close(fd);
         }
         else
@@ -105,50 +102,9 @@ int LightSensor::setEnable(int32_t handle, int enabled)
     return err;
 }
 
-bool LightSensor::hasPendingEvents() const
+bool LightSensor::accept(int id)
 {
-    return mHasPendingEvent;
-}
-
-int LightSensor::readEvents(sensors_event_t* data, int count)
-{
-     if (count < 1)
-        return -EINVAL;
-    if (mHasPendingEvent) {
-        mHasPendingEvent = false;
-        mPendingEvents.timestamp = getTimestamp();
-        *data = mPendingEvents;
-        return mEnabled ? 1 : 0;
-    }
-
-    ssize_t n = mInputReader.fill(data_fd);
-    if (n < 0)
-        return n;
-
-    int numEventReceived = 0;
-    input_event const* event;
-
-    while (count && mInputReader.readEvent(&event)) {
-        int type = event->type;
-        if (type == EV_ABS) {
-            if (event->code == EVENT_TYPE_LIGHT) {         
-			mPendingEvents.light = (float)event->value;      
-			//LOGE("LightSensor readEvents value=%f",mPendingEvents.light);
-		}
-        } else if (type == EV_SYN) {
-            mPendingEvents.timestamp = timevalToNano(event->time);       
-		if (mEnabled) {            
-			*data++ = mPendingEvents;
-			count--; 
-			numEventReceived++; 
-		}
-        } else {
-            LOGE("AkmSensor: unknown event (type=%d, code=%d)",
-                    type, event->code);
-        }
-	 mInputReader.next();
-    }
-    return numEventReceived;
+    return mEnabled && mFilter.update(mPendingEvents[Light].light);
 }
 
 int LightSensor::setDelay(int32_t handle, int64_t ns)
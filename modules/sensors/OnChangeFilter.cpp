@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
+#include "sensors.h"
+#include "OnChangeFilter.h"
+
+/*****************************************************************************/
+
+static int getIntProperty(const char* key, int def) {
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get(key, value, NULL) > 0) {
+        return atoi(value);
+    }
+    return def;
+}
+
+/*****************************************************************************/
+
+LightHysteresis::LightHysteresis()
+    : mReported(0), mValid(false)
+{
+    mPercent = getIntProperty("ro.sensors.als.hysteresis",
+            LIGHT_HYSTERESIS_PERCENT) / 100.0f;
+    mMinDelta = getIntProperty("ro.sensors.als.min_delta",
+            LIGHT_HYSTERESIS_MIN_LUX);
+}
+
+bool LightHysteresis::update(float lux)
+{
+    if (mValid) {
+        // the band is relative to the last reported value, so that it
+        // scales from a dark room to direct sunlight; darkness itself
+        // is always reported.
+        float delta = lux - mReported;
+        if (delta < 0)
+            delta = -delta;
+        float band = mReported * mPercent;
+        if (band < mMinDelta)
+            band = mMinDelta;
+        if (delta < band && !(lux == 0 && mReported != 0))
+            return false;
+    }
+    mReported = lux;
+    mValid = true;
+    return true;
+}
+
+/*****************************************************************************/
+
+ProximityDebounce::ProximityDebounce()
+    : mReported(0), mCandidate(0), mCount(0), mValid(false)
+{
+    mThreshold = getIntProperty("ro.sensors.prox.debounce",
+            PROXIMITY_DEBOUNCE_COUNT);
+    if (mThreshold < 1)
+        mThreshold = 1;
+}
+
+bool ProximityDebounce::update(float distance)
+{
+    if (!mValid) {
+        mReported = distance;
+        mValid = true;
+        mCount = 0;
+        return true;
+    }
+    if (distance == mReported) {
+        // back to the reported state, drop the glitch
+        mCount = 0;
+        return false;
+    }
+    // a new state must be seen on mThreshold consecutive samples
+    if (mCount == 0 || distance != mCandidate) {
+        mCandidate = distance;
+        mCount = 0;
+    }
+    if (++mCount < mThreshold)
+        return false;
+    mReported = distance;
+    mCount = 0;
+    return true;
+}
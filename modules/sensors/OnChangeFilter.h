@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_ON_CHANGE_FILTER_H
+#define ANDROID_ON_CHANGE_FILTER_H
+
+#include <stdint.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+/*****************************************************************************/
+
+/*
+ * Light and proximity are on-change sensors: an event that doesn't change
+ * the reported value only wakes up the framework for nothing. These
+ * filters sit between the driver and the poll loop and return true when
+ * a value is worth reporting. reset() must be called when the sensor is
+ * enabled, so that the first value always goes through.
+ */
+
+class LightHysteresis {
+    float mReported;
+    bool mValid;
+    float mPercent;
+    float mMinDelta;
+
+public:
+            LightHysteresis();
+    void reset() { mValid = false; }
+    bool update(float lux);
+};
+
+class ProximityDebounce {
+    float mReported;
+    float mCandidate;
+    int mCount;
+    int mThreshold;
+    bool mValid;
+
+public:
+            ProximityDebounce();
+    void reset() { mValid = false; mCount = 0; }
+    bool update(float distance);
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_ON_CHANGE_FILTER_H
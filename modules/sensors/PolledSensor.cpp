@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#include <cutils/log.h>
+
+#include "PolledSensor.h"
+
+/* never sample faster than this, whatever the framework asks for */
+#define POLL_MIN_PERIOD         20000000LL
+/* relative change that counts as "moving" */
+#define POLL_CHANGE_THRESHOLD   0.05f
+
+/*****************************************************************************/
+
+PolledSensor::PolledSensor(const char* valuePath, int handle, int type,
+        float scale, int64_t maxPeriod)
+    : SensorBase(NULL, NULL),
+      mHandle(handle),
+      mScale(scale),
+      mEnabled(0),
+      mMinPeriod(POLL_MIN_PERIOD),
+      mMaxPeriod(maxPeriod),
+      mPeriod(POLL_MIN_PERIOD),
+      mLastValue(0),
+      mHasValue(false)
+{
+    strlcpy(mValuePath, valuePath, sizeof(mValuePath));
+    memset(&mPendingEvent, 0, sizeof(mPendingEvent));
+    mPendingEvent.version = sizeof(sensors_event_t);
+    mPendingEvent.sensor = handle;
+    mPendingEvent.type = type;
+
+    mTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    LOGE_IF(mTimerFd<0, "PolledSensor: timerfd_create failed (%s)",
+            strerror(errno));
+}
+
+PolledSensor::~PolledSensor()
+{
+    if (mTimerFd >= 0) {
+        close(mTimerFd);
+    }
+}
+
+bool PolledSensor::isAvailable() const
+{
+    return mTimerFd >= 0 && access(mValuePath, R_OK) == 0;
+}
+
+int PolledSensor::getFd() const
+{
+    return mTimerFd;
+}
+
+int PolledSensor::armTimer(int64_t ns)
+{
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    // one-shot, so that each period can be chosen after the last sample
+    spec.it_value.tv_sec  = ns / 1000000000LL;
+    spec.it_value.tv_nsec = ns % 1000000000LL;
+    if (timerfd_settime(mTimerFd, 0, &spec, NULL) < 0) {
+        LOGE("PolledSensor: timerfd_settime failed (%s)", strerror(errno));
+        return -errno;
+    }
+    return 0;
+}
+
+int PolledSensor::readValue(float* value)
+{
+    char buffer[32];
+    int fd = open(mValuePath, O_RDONLY);
+    if (fd < 0)
+        return -errno;
+    ssize_t n = read(fd, buffer, sizeof(buffer) - 1);
+    int err = (n < 0) ? -errno : 0;
+    close(fd);
+    if (n <= 0)
+        return err ? err : -EIO;
+    buffer[n] = '\0';
+    *value = atoi(buffer) * mScale;
+    return 0;
+}
+
+void PolledSensor::adaptPeriod(float value)
+{
+    if (mHasValue) {
+        float ref = fabsf(mLastValue);
+        if (ref < 1.0f)
+            ref = 1.0f;
+        if (fabsf(value - mLastValue) > ref * POLL_CHANGE_THRESHOLD) {
+            // moving: converge quickly on the requested rate
+            mPeriod /= 4;
+        } else {
+            // stable: back off slowly
+            mPeriod *= 2;
+        }
+    }
+    if (mPeriod > mMaxPeriod)
+        mPeriod = mMaxPeriod;
+    if (mPeriod < mMinPeriod)
+        mPeriod = mMinPeriod;
+}
+
+int PolledSensor::readEvents(sensors_event_t* data, int count)
+{
+    if (count < 1)
+        return -EINVAL;
+
+    uint64_t expirations;
+    if (read(mTimerFd, &expirations, sizeof(expirations)) < 0) {
+        return (errno == EAGAIN) ? 0 : -errno;
+    }
+    if (!mEnabled)
+        return 0;
+
+    int numEventReceived = 0;
+    float value;
+    if (readValue(&value) == 0) {
+        adaptPeriod(value);
+        mLastValue = value;
+        mHasValue = true;
+        mPendingEvent.data[0] = value;
+        mPendingEvent.timestamp = getTimestamp();
+        if (accept(value)) {
+            *data = mPendingEvent;
+            numEventReceived++;
+        }
+    }
+    armTimer(mPeriod);
+    return numEventReceived;
+}
+
+int PolledSensor::setEnable(int32_t handle, int enabled)
+{
+    if (handle != mHandle)
+        return -EINVAL;
+
+    int flags = enabled ? 1 : 0;
+    if (flags != mEnabled) {
+        mEnabled = flags;
+        mHasValue = false;
+        mPeriod = mMinPeriod;
+        // first sample right away, disabling disarms the timer
+        return armTimer(flags ? 1 : 0);
+    }
+    return 0;
+}
+
+int PolledSensor::getEnable(int32_t handle)
+{
+    return (handle == mHandle) ? mEnabled : 0;
+}
+
+int PolledSensor::setDelay(int32_t handle, int64_t ns)
+{
+    if (handle != mHandle)
+        return -EINVAL;
+
+    if (ns < POLL_MIN_PERIOD)
+        ns = POLL_MIN_PERIOD;
+    mMinPeriod = ns;
+    if (mPeriod < mMinPeriod)
+        mPeriod = mMinPeriod;
+    return 0;
+}
+
+int64_t PolledSensor::getDelay(int32_t handle)
+{
+    return (handle == mHandle) ? mMinPeriod : 0;
+}
+
+/*****************************************************************************/
+
+PolledLightSensor::PolledLightSensor(const char* valuePath)
+    : PolledSensor(valuePath, ID_L, SENSOR_TYPE_LIGHT, 1.0f,
+            LIGHT_SENSOR_POLLTIME)
+{
+}
+
+int PolledLightSensor::setEnable(int32_t handle, int enabled)
+{
+    if (enabled && !getEnable(handle))
+        mFilter.reset();
+    return PolledSensor::setEnable(handle, enabled);
+}
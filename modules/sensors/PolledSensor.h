@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_POLLED_SENSOR_H
+#define ANDROID_POLLED_SENSOR_H
+
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include "sensors.h"
+#include "SensorBase.h"
+#include "OnChangeFilter.h"
+
+/*****************************************************************************/
+
+/*
+ * Sensor whose driver only exposes its value in sysfs. A timerfd takes
+ * the place of the input device in the poll loop; each expiration samples
+ * the attribute once. The period shrinks quickly while the value moves
+ * and backs off towards maxPeriod while it is stable, but never goes
+ * below the delay requested by the framework.
+ */
+
+class PolledSensor : public SensorBase {
+    char mValuePath[PATH_MAX];
+    int mHandle;
+    float mScale;
+    int mEnabled;
+    int mTimerFd;
+    int64_t mMinPeriod;
+    int64_t mMaxPeriod;
+    int64_t mPeriod;
+    float mLastValue;
+    bool mHasValue;
+    sensors_event_t mPendingEvent;
+
+    int armTimer(int64_t ns);
+    int readValue(float* value);
+    void adaptPeriod(float value);
+
+protected:
+    /* returns true if value must be reported to the framework */
+    virtual bool accept(float value) { return true; }
+
+public:
+            PolledSensor(const char* valuePath, int handle, int type,
+                    float scale, int64_t maxPeriod);
+    virtual ~PolledSensor();
+    virtual int readEvents(sensors_event_t* data, int count);
+    virtual int getFd() const;
+    virtual int setDelay(int32_t handle, int64_t ns);
+    virtual int64_t getDelay(int32_t handle);
+    virtual int setEnable(int32_t handle, int enabled);
+    virtual int getEnable(int32_t handle);
+    bool isAvailable() const;
+};
+
+class PolledLightSensor : public PolledSensor {
+    LightHysteresis mFilter;
+protected:
+    virtual bool accept(float value) { return mFilter.update(value); }
+public:
+            PolledLightSensor(const char* valuePath);
+    virtual int setEnable(int32_t handle, int enabled);
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_POLLED_SENSOR_H
@@ -25,17 +25,18 @@
 #define ps_enable_path              "/sys/devices/platform/stk-oss/ps_enable"
 /*****************************************************************************/
 
+/* In distance mode, SenseTek driver will report 0 (near) or 1 (far) */
+const evdev_field ProximityTraits::fields[] = {
+    { EVENT_TYPE_PROXIMITY, Proximity, EVDEV_SCALED, 0, 10.0f, 0 },
+};
+const int ProximityTraits::numFields = ARRAY_SIZE(ProximityTraits::fields);
+
 ProximitySensor::ProximitySensor()
-    : SensorBase(NULL, SENSOR_NAME),
-      mPendingMask(0),
-      mInputReader(4),
-      mHasPendingEvent(false)
+    : EvdevSensor<ProximityTraits>(NULL, SENSOR_NAME, 4)
 {
-    memset(mPendingEvent.data, 0, sizeof(mPendingEvent.data));
     mEnabled=0;
-    mPendingEvent.version = sizeof(sensors_event_t);
-    mPendingEvent.sensor = ID_P;
-    mPendingEvent.type = SENSOR_TYPE_PROXIMITY;
+    mPendingEvents[Proximity].sensor = ID_P;
+    mPendingEvents[Proximity].type = SENSOR_TYPE_PROXIMITY;
     int fd = open(ps_enable_path,O_RDONLY);
 
     if (fd>=0)
@@ -64,13 +65,8 @@ ProximitySensor::~ProximitySensor()
 }
 
 int ProximitySensor::setInitialState() {   
-    struct input_absinfo absinfo;
-    if (!ioctl(data_fd, EVIOCGABS(EVENT_TYPE_PROXIMITY), &absinfo)) {
-        mPendingEvent.distance = (float)(absinfo.value ? 10:0);
-        mHasPendingEvent = true;
-    }
-	else
-		LOGE("%s:ioctl failed!", __func__);			
+    readAbsState(1<<Proximity);
+    LOGE_IF(!mHasPendingEvent, "%s:ioctl failed!", __func__);
     return 0;
 }
 int ProximitySensor::setEnable(int32_t handle, int enabled)
@@ -90,8 +86,10 @@ int ProximitySensor::setEnable(int32_t handle, int enabled)
 			}			
             mEnabled = bEnable;
             err = 0;
-            if (mEnabled)
+            if (mEnabled) {
+                mFilter.reset();
                 setInitialState();
+            }
             close(fd);
         }
         else
@@ -103,57 +101,9 @@ int ProximitySensor::setEnable(int32_t handle, int enabled)
     return err;
 }
 
-bool ProximitySensor::hasPendingEvents() const
+bool ProximitySensor::accept(int id)
 {
-    return mHasPendingEvent;
-}
-
-int ProximitySensor::readEvents(sensors_event_t* data, int count)
-{
-    LOGD("LightSensor::readEvents count = %d", count);
-
-     if (count < 1)
-        return -EINVAL;
-
-    if (mHasPendingEvent) {
-        mHasPendingEvent = false;
-        mPendingEvent.timestamp = getTimestamp();
-        *data = mPendingEvent;
-        return mEnabled ? 1 : 0;
-    }
-
-    ssize_t n = mInputReader.fill(data_fd);
-    if (n < 0)
-        return n;
-
-    int numEventReceived = 0;
-    input_event const* event;
-
-    while (count && mInputReader.readEvent(&event)) {
-        int type = event->type;
-        if (type == EV_ABS) {
-          //  processEvent(event->code, event->value);
-          //  mInputReader.next();
-           if (event->code == EVENT_TYPE_PROXIMITY) {          
-		   	// In distance mode, SenseTek driver will report 0(near) or 1 (far)         
-		   	// convert to float directly   
-		   	mPendingEvent.distance = ((float)event->value)*10.0f;       
-			LOGE("ProximitySensor readevents distance%f",mPendingEvent.distance);
-		}
-        } else if (type == EV_SYN) {
-            mPendingEvent.timestamp = timevalToNano(event->time);         
-		if (mEnabled) {             
-			*data++ = mPendingEvent;         
-			count--;          
-			numEventReceived++;        
-		}
-        } else {
-            LOGE("STKProximitySensor: unknown event (type=%d, code=%d)",
-                    type, event->code);
-        }
-	   mInputReader.next();
-    }
-    return numEventReceived;
+    return mEnabled && mFilter.update(mPendingEvents[Proximity].distance);
 }
 
 /*void ProximitySensor::processEvent(int code, int value)
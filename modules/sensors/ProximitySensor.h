@@ -18,21 +18,26 @@
 #define ANDROID_PROXIMITY_SENSOR_H
 
 #include "sensors.h"
-#include "SensorBase.h"
-#include "InputEventReader.h"
+#include "EvdevSensor.h"
+#include "OnChangeFilter.h"
 
 /*****************************************************************************/
 
-struct input_event;
+struct ProximityTraits {
+    enum {
+        Proximity = 0,
+        numSensors
+    };
+    static const evdev_field fields[];
+    static const int numFields;
+};
 
-class ProximitySensor : public SensorBase {
+class ProximitySensor : public EvdevSensor<ProximityTraits> {
 public:
             ProximitySensor();
     virtual ~ProximitySensor();
-    virtual int readEvents(sensors_event_t* data, int count);
   //  virtual bool hasPendingEvents() const;
     //virtual int enable(int32_t handle, int enabled);
-    virtual bool hasPendingEvents() const;
     virtual int setDelay(int32_t handle, int64_t ns);
     virtual int setEnable(int32_t handle, int enabled);
     virtual int64_t getDelay(int32_t handle);
@@ -41,15 +46,14 @@ public:
 private:
 
     int mEnabled;
-    uint32_t mPendingMask;
-    InputEventCircularReader mInputReader;
-    sensors_event_t mPendingEvent;
-    bool mHasPendingEvent;
+    ProximityDebounce mFilter;
     //char input_sysfs_path[256];
     //int input_sysfs_path_len;
    // int alsEnabled;
    // int psEnabled;
 
+    virtual bool accept(int id);
+
    // void processEvent(int code, int value);
  //  int handle2id(int32_t handle);
    
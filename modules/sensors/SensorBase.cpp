@@ -30,11 +30,35 @@
 
 /*****************************************************************************/
 
+#ifndef EVIOCSCLOCKID
+#define EVIOCSCLOCKID           _IOW('E', 0xa0, int)
+#endif
+
+/* how often the realtime-to-monotonic offset is re-sampled */
+#define CLOCK_OFFSET_PERIOD     100000000LL
+/* a larger jump is a step of the wall clock, not drift */
+#define CLOCK_OFFSET_STEP       1000000LL
+/* weight of a new offset sample is 1/2^CLOCK_OFFSET_SHIFT */
+#define CLOCK_OFFSET_SHIFT      3
+
+static int64_t sClockOffset;
+static int64_t sClockOffsetTime;
+static bool sClockOffsetValid = false;
+
+static int64_t readClock(clockid_t clock) {
+    struct timespec t;
+    t.tv_sec = t.tv_nsec = 0;
+    clock_gettime(clock, &t);
+    return int64_t(t.tv_sec)*1000000000LL + t.tv_nsec;
+}
+
+/*****************************************************************************/
+
 SensorBase::SensorBase(
         const char* dev_name,
         const char* data_name)
     : dev_name(dev_name), data_name(data_name),
-      dev_fd(-1), data_fd(-1)
+      dev_fd(-1), data_fd(-1), data_monotonic(false)
 {
     if (data_name) {
 	if (strcmp(data_name,"bma2x2,mc32x0")!=0)
@@ -116,15 +140,54 @@ int64_t SensorBase::getDelay(int32_t handle) {
     return 0;
 }
 
+int SensorBase::getReportSize() const {
+    return 0;
+}
+
 bool SensorBase::hasPendingEvents() const {
     return false;
 }
 
 int64_t SensorBase::getTimestamp() {
-    struct timespec t;
-    t.tv_sec = t.tv_nsec = 0;
-    clock_gettime(CLOCK_MONOTONIC, &t);
-    return int64_t(t.tv_sec)*1000000000LL + t.tv_nsec;
+    return readClock(CLOCK_MONOTONIC);
+}
+
+/*
+ * Input drivers on older kernels stamp events with CLOCK_REALTIME, while
+ * the framework expects CLOCK_MONOTONIC. We keep a filtered estimate of
+ * the offset between the two clocks: each sample is bracketed by two
+ * monotonic reads and the tightest of a few brackets is kept, small
+ * deviations (NTP slewing) are smoothed, and large ones (settimeofday)
+ * reset the estimate.
+ */
+int64_t SensorBase::realtimeToMonotonic(int64_t realtime) {
+    const int64_t now = readClock(CLOCK_MONOTONIC);
+    if (!sClockOffsetValid || now - sClockOffsetTime >= CLOCK_OFFSET_PERIOD) {
+        int64_t best = 0;
+        int64_t bestWidth = -1;
+        for (int i=0 ; i<3 ; i++) {
+            int64_t m0 = readClock(CLOCK_MONOTONIC);
+            int64_t r  = readClock(CLOCK_REALTIME);
+            int64_t m1 = readClock(CLOCK_MONOTONIC);
+            if (bestWidth < 0 || m1 - m0 < bestWidth) {
+                bestWidth = m1 - m0;
+                best = r - (m0 + (m1 - m0) / 2);
+            }
+        }
+        int64_t error = best - sClockOffset;
+        if (!sClockOffsetValid ||
+                error > CLOCK_OFFSET_STEP || error < -CLOCK_OFFSET_STEP) {
+            sClockOffset = best;
+            sClockOffsetValid = true;
+        } else {
+            sClockOffset += error >> CLOCK_OFFSET_SHIFT;
+        }
+        sClockOffsetTime = now;
+    }
+
+    int64_t t = realtime - sClockOffset;
+    // an event can't have happened in the future
+    return (t > now) ? now : t;
 }
 
 int SensorBase::openInput(const char* inputName) {
@@ -154,6 +217,11 @@ int SensorBase::openInput(const char* inputName) {
             }
             if (!strcmp(name, inputName)) {
                 strcpy(input_name, filename);
+                int clockId = CLOCK_MONOTONIC;
+                data_monotonic = !ioctl(fd, EVIOCSCLOCKID, &clockId);
+                LOGD_IF(!data_monotonic,
+                        "%s: no EVIOCSCLOCKID, rebasing realtime timestamps",
+                        inputName);
                 break;
             } else {
                 close(fd);
@@ -34,15 +34,23 @@ protected:
     char        input_name[PATH_MAX];
     int         dev_fd;
     int         data_fd;
+    bool        data_monotonic;
 
     int openInput(const char* inputName);
     static int64_t getTimestamp();
+    static int64_t realtimeToMonotonic(int64_t realtime);
 
 
     static int64_t timevalToNano(timeval const& t) {
         return t.tv_sec*1000000000LL + t.tv_usec*1000;
     }
 
+    /* timestamp of an input event, in the CLOCK_MONOTONIC time base */
+    int64_t getInputTimestamp(timeval const& t) const {
+        int64_t ns = timevalToNano(t);
+        return data_monotonic ? ns : realtimeToMonotonic(ns);
+    }
+
     int open_device();
     int close_device();
 	int write_int(char const *path, int value);
@@ -63,6 +71,9 @@ public:
     virtual int setDelay(int32_t handle, int64_t ns);
     virtual int64_t getDelay(int32_t handle);
 
+    /* most input events one report takes, 0 if there's no input device */
+    virtual int getReportSize() const;
+
 	/* When this function is called, increments the reference counter. */
     virtual int setEnable(int32_t handle, int enabled) = 0;
 	/* It returns the number of reference. */
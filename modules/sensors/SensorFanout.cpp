@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include <cutils/ashmem.h>
+#include <cutils/atomic.h>
+#include <cutils/log.h>
+#include <cutils/sockets.h>
+
+#include "SensorFanout.h"
+
+#define AID_ROOT    0
+#define AID_SYSTEM  1000
+
+/*****************************************************************************/
+
+SensorFanout::SensorFanout(sensors_poll_device_t* device)
+    : mDevice(device),
+      mRingFd(-1),
+      mHeader(0),
+      mSlots(0),
+      mServerFd(-1),
+      mThreadStarted(false)
+{
+    mExitPipe[0] = mExitPipe[1] = -1;
+    for (int i=0 ; i<MAX_CLIENTS ; i++) {
+        mClients[i].fd = -1;
+        mClients[i].enabled = 0;
+    }
+
+    mRingFd = ashmem_create_region("sensors-ring", SENSORS_RING_SIZE);
+    if (mRingFd < 0) {
+        LOGE("SensorFanout: couldn't create ashmem (%s)", strerror(errno));
+        return;
+    }
+    void* base = mmap(0, SENSORS_RING_SIZE, PROT_READ|PROT_WRITE,
+            MAP_SHARED, mRingFd, 0);
+    if (base == MAP_FAILED) {
+        LOGE("SensorFanout: couldn't map the ring (%s)", strerror(errno));
+        return;
+    }
+    // clients only ever get a read-only view
+    ashmem_set_prot_region(mRingFd, PROT_READ);
+
+    mHeader = (sensors_ring_header*)base;
+    mSlots = (sensors_ring_slot*)(mHeader + 1);
+    for (int i=0 ; i<SENSORS_RING_CAPACITY ; i++) {
+        // no sequence number maps to slot i yet
+        mSlots[i].seq = i + 1;
+    }
+    mHeader->event_size = sizeof(sensors_event_t);
+    mHeader->capacity = SENSORS_RING_CAPACITY;
+    mHeader->head = 0;
+    android_memory_barrier();
+    mHeader->magic = SENSORS_RING_MAGIC;
+
+    mServerFd = socket_local_server(SENSORS_RING_SOCKET,
+            ANDROID_SOCKET_NAMESPACE_ABSTRACT, SOCK_STREAM);
+    if (mServerFd < 0) {
+        LOGE("SensorFanout: couldn't create socket (%s)", strerror(errno));
+        return;
+    }
+    if (pipe(mExitPipe) < 0) {
+        LOGE("SensorFanout: couldn't create pipe (%s)", strerror(errno));
+        return;
+    }
+    mThreadStarted = !pthread_create(&mThread, NULL, threadLoop, this);
+    LOGE_IF(!mThreadStarted, "SensorFanout: couldn't start service thread");
+}
+
+SensorFanout::~SensorFanout()
+{
+    if (mThreadStarted) {
+        char c = 'X';
+        write(mExitPipe[1], &c, 1);
+        pthread_join(mThread, NULL);
+    }
+    for (int i=0 ; i<MAX_CLIENTS ; i++) {
+        if (mClients[i].fd >= 0)
+            dropClient(&mClients[i]);
+    }
+    if (mExitPipe[0] >= 0) {
+        close(mExitPipe[0]);
+        close(mExitPipe[1]);
+    }
+    if (mServerFd >= 0)
+        close(mServerFd);
+    if (mHeader)
+        munmap(mHeader, SENSORS_RING_SIZE);
+    if (mRingFd >= 0)
+        close(mRingFd);
+}
+
+bool SensorFanout::isReady() const
+{
+    return mThreadStarted;
+}
+
+void SensorFanout::publish(const sensors_event_t* data, int count)
+{
+    if (!mHeader || count <= 0)
+        return;
+
+    const int32_t mask = SENSORS_RING_CAPACITY - 1;
+    int32_t head = mHeader->head;
+    for (int i=0 ; i<count ; i++, head++) {
+        sensors_ring_slot* slot = &mSlots[head & mask];
+        // invalidate the slot first, so that a lapped reader can't take
+        // a half-written event for the one it expects
+        slot->seq = head + 1;
+        android_memory_barrier();
+        slot->event = data[i];
+        android_memory_barrier();
+        slot->seq = head;
+    }
+    android_memory_barrier();
+    mHeader->head = head;
+    syscall(__NR_futex, &mHeader->head, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+}
+
+/*****************************************************************************/
+
+void* SensorFanout::threadLoop(void* arg)
+{
+    SensorFanout* self = (SensorFanout*)arg;
+    struct pollfd fds[2 + MAX_CLIENTS];
+
+    for (;;) {
+        int n = 0;
+        fds[n].fd = self->mExitPipe[0];
+        fds[n++].events = POLLIN;
+        fds[n].fd = self->mServerFd;
+        fds[n++].events = POLLIN;
+        for (int i=0 ; i<MAX_CLIENTS ; i++) {
+            fds[n].fd = self->mClients[i].fd;
+            fds[n++].events = POLLIN;
+        }
+
+        if (poll(fds, n, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            LOGE("SensorFanout: poll() failed (%s)", strerror(errno));
+            break;
+        }
+        if (fds[0].revents)
+            break;
+        if (fds[1].revents & POLLIN)
+            self->acceptClient();
+        for (int i=0 ; i<MAX_CLIENTS ; i++) {
+            if (fds[2 + i].fd >= 0 && fds[2 + i].revents) {
+                if (!self->handleCommand(&self->mClients[i]))
+                    self->dropClient(&self->mClients[i]);
+            }
+        }
+    }
+    return NULL;
+}
+
+void SensorFanout::acceptClient()
+{
+    int fd = accept(mServerFd, NULL, NULL);
+    if (fd < 0)
+        return;
+
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0 ||
+            (cred.uid != AID_ROOT && cred.uid != AID_SYSTEM &&
+             cred.uid != getuid())) {
+        LOGW("SensorFanout: rejecting client");
+        close(fd);
+        return;
+    }
+
+    client_t* client = 0;
+    for (int i=0 ; i<MAX_CLIENTS && !client ; i++) {
+        if (mClients[i].fd < 0)
+            client = &mClients[i];
+    }
+    if (!client) {
+        LOGW("SensorFanout: too many clients");
+        close(fd);
+        return;
+    }
+
+    // hand over the ring's fd
+    struct msghdr msg;
+    struct iovec iov;
+    char cbuf[CMSG_SPACE(sizeof(int))];
+    char c = 'R';
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = &c;
+    iov.iov_len = 1;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &mRingFd, sizeof(int));
+    if (sendmsg(fd, &msg, 0) != 1) {
+        close(fd);
+        return;
+    }
+    client->fd = fd;
+    client->enabled = 0;
+}
+
+bool SensorFanout::handleCommand(client_t* client)
+{
+    sensors_ring_command cmd;
+    if (read(client->fd, &cmd, sizeof(cmd)) != sizeof(cmd))
+        return false;
+
+    int32_t status = -EINVAL;
+    if (cmd.handle >= 0 && cmd.handle < SENSORS_RING_MAX_HANDLES) {
+        const uint32_t bit = 1LU << cmd.handle;
+        switch (cmd.what) {
+            case SENSORS_RING_ACTIVATE:
+                // one reference per client and handle
+                if (!cmd.value == !(client->enabled & bit)) {
+                    status = 0;
+                    break;
+                }
+                status = mDevice->activate(mDevice, cmd.handle, cmd.value != 0);
+                if (status == 0)
+                    client->enabled ^= bit;
+                break;
+            case SENSORS_RING_SET_DELAY:
+                status = mDevice->setDelay(mDevice, cmd.handle, cmd.value);
+                break;
+        }
+    }
+    return write(client->fd, &status, sizeof(status)) == sizeof(status);
+}
+
+void SensorFanout::dropClient(client_t* client)
+{
+    // release whatever this client left enabled
+    for (int h=0 ; client->enabled ; h++) {
+        if (client->enabled & (1LU << h)) {
+            mDevice->activate(mDevice, h, 0);
+            client->enabled &= ~(1LU << h);
+        }
+    }
+    close(client->fd);
+    client->fd = -1;
+}
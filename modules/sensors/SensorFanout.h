@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSOR_FANOUT_H
+#define ANDROID_SENSOR_FANOUT_H
+
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include <hardware/sensors.h>
+#include <hardware/sensors_ring.h>
+
+/*****************************************************************************/
+
+/*
+ * Writer side of the fan-out ring described in <hardware/sensors_ring.h>.
+ * publish() is called from the poll loop; a service thread hands the ring
+ * to clients and forwards their activate/setDelay requests to the device.
+ */
+
+class SensorFanout {
+    enum { MAX_CLIENTS = 8 };
+
+    struct client_t {
+        int fd;
+        uint32_t enabled;   // handles this client has activated
+    };
+
+    sensors_poll_device_t* mDevice;
+    int mRingFd;
+    sensors_ring_header* mHeader;
+    sensors_ring_slot* mSlots;
+    int mServerFd;
+    int mExitPipe[2];
+    pthread_t mThread;
+    bool mThreadStarted;
+    client_t mClients[MAX_CLIENTS];
+
+    static void* threadLoop(void* arg);
+    void acceptClient();
+    bool handleCommand(client_t* client);
+    void dropClient(client_t* client);
+
+public:
+            SensorFanout(sensors_poll_device_t* device);
+            ~SensorFanout();
+    bool isReady() const;
+    void publish(const sensors_event_t* data, int count);
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_SENSOR_FANOUT_H
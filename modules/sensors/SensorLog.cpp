@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cutils/log.h>
+
+#include "sensors.h"
+#include "SensorLog.h"
+
+/*****************************************************************************/
+
+/* number of meaningful floats in the event, and whether it has a status */
+static int numValues(int type, bool* hasStatus)
+{
+    *hasStatus = false;
+    switch (type) {
+        case SENSOR_TYPE_ACCELEROMETER:
+        case SENSOR_TYPE_MAGNETIC_FIELD:
+        case SENSOR_TYPE_ORIENTATION:
+        case SENSOR_TYPE_GYROSCOPE:
+            *hasStatus = true;
+            return 3;
+        case SENSOR_TYPE_GRAVITY:
+        case SENSOR_TYPE_LINEAR_ACCELERATION:
+            return 3;
+        case SENSOR_TYPE_ROTATION_VECTOR:
+            return 4;
+    }
+    return 1;
+}
+
+SensorLog::SensorLog(const char* path)
+    : mPath(path),
+      mFd(-1),
+      mFileSize(0),
+      mUsed(0)
+{
+    openFile();
+}
+
+SensorLog::~SensorLog()
+{
+    if (mFd >= 0) {
+        flush();
+        close(mFd);
+    }
+}
+
+bool SensorLog::isReady() const
+{
+    return mFd >= 0;
+}
+
+int SensorLog::openFile()
+{
+    mFd = open(mPath, O_WRONLY|O_CREAT|O_TRUNC, 0600);
+    if (mFd < 0) {
+        LOGE("SensorLog: couldn't create %s (%s)", mPath, strerror(errno));
+        return -errno;
+    }
+
+    // every file starts over with key records
+    memset(mState, 0, sizeof(mState));
+    for (int i=0 ; i<SENSORS_LOG_MAX_HANDLES ; i++)
+        mState[i].type = -1;
+
+    sensors_log_header header;
+    header.magic = SENSORS_LOG_MAGIC;
+    header.version = SENSORS_LOG_VERSION;
+    header.scale = SENSORS_LOG_SCALE;
+    header.reserved = 0;
+    memcpy(mBuffer, &header, sizeof(header));
+    mUsed = sizeof(header);
+    mFileSize = 0;
+    return 0;
+}
+
+void SensorLog::flush()
+{
+    if (!mUsed)
+        return;
+    ssize_t n = write(mFd, mBuffer, mUsed);
+    LOGE_IF(n != ssize_t(mUsed), "SensorLog: write failed (%s)",
+            strerror(errno));
+    mFileSize += mUsed;
+    mUsed = 0;
+
+    if (mFileSize >= SENSORS_LOG_MAX_SIZE) {
+        char old[PATH_MAX];
+        snprintf(old, sizeof(old), "%s.1", mPath);
+        close(mFd);
+        rename(mPath, old);
+        openFile();
+    }
+}
+
+void SensorLog::encode(const sensors_event_t& ev)
+{
+    if (ev.sensor < 0 || ev.sensor >= SENSORS_LOG_MAX_HANDLES)
+        return;
+
+    state_t& s = mState[ev.sensor];
+    bool hasStatus;
+    const int count = numValues(ev.type, &hasStatus);
+    const int status = hasStatus ? ev.magnetic.status : 0;
+
+    int32_t values[SENSORS_LOG_MAX_VALUES];
+    for (int i=0 ; i<count ; i++)
+        values[i] = lrintf(ev.data[i] * SENSORS_LOG_SCALE);
+
+    uint8_t* p = mBuffer + mUsed;
+    if (ev.type != s.type || count != s.count || status != s.status ||
+            s.sinceKey >= SENSORS_LOG_KEY_INTERVAL) {
+        *p++ = SENSORS_LOG_KEY | ev.sensor;
+        p = sensors_log_put_varint(p, ev.type);
+        p = sensors_log_put_varint(p, count);
+        p = sensors_log_put_varint(p, sensors_log_zigzag(status));
+        p = sensors_log_put_varint(p, sensors_log_zigzag(ev.timestamp));
+        for (int i=0 ; i<count ; i++)
+            p = sensors_log_put_varint(p, sensors_log_zigzag(values[i]));
+        s.type = ev.type;
+        s.count = count;
+        s.status = status;
+        s.sinceKey = 0;
+        s.delta = 0;
+    } else {
+        // at a steady rate the timestamp costs a single byte
+        const int64_t delta = ev.timestamp - s.timestamp;
+        *p++ = ev.sensor;
+        p = sensors_log_put_varint(p, sensors_log_zigzag(delta - s.delta));
+        for (int i=0 ; i<count ; i++) {
+            p = sensors_log_put_varint(p,
+                    sensors_log_zigzag(int64_t(values[i]) - s.values[i]));
+        }
+        s.delta = delta;
+        s.sinceKey++;
+    }
+    s.timestamp = ev.timestamp;
+    memcpy(s.values, values, count * sizeof(int32_t));
+    mUsed = p - mBuffer;
+}
+
+void SensorLog::log(const sensors_event_t* data, int count)
+{
+    if (mFd < 0)
+        return;
+    for (int i=0 ; i<count ; i++) {
+        if (mUsed + SENSORS_LOG_MAX_RECORD > BUFFER_SIZE) {
+            flush();
+            if (mFd < 0)
+                return;
+        }
+        encode(data[i]);
+    }
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSOR_LOG_H
+#define ANDROID_SENSOR_LOG_H
+
+#include <stdint.h>
+#include <errno.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include <hardware/sensors.h>
+#include <hardware/sensors_log.h>
+
+/*****************************************************************************/
+
+/*
+ * Compressed log of the events returned by the HAL, see sensors_log.h for
+ * the format. Records are encoded into a fixed buffer that is written out
+ * when full, and the file is rotated to <path>.1 once it reaches
+ * SENSORS_LOG_MAX_SIZE, so both memory and storage use are bounded.
+ */
+
+class SensorLog {
+    enum { BUFFER_SIZE = 16384 };
+
+    struct state_t {
+        int32_t type;
+        int32_t count;
+        int32_t status;
+        int32_t sinceKey;
+        int64_t timestamp;
+        int64_t delta;
+        int32_t values[SENSORS_LOG_MAX_VALUES];
+    };
+
+    const char* mPath;
+    int mFd;
+    size_t mFileSize;
+    size_t mUsed;
+    uint8_t mBuffer[BUFFER_SIZE];
+    state_t mState[SENSORS_LOG_MAX_HANDLES];
+
+    int openFile();
+    void flush();
+    void encode(const sensors_event_t& ev);
+
+public:
+            SensorLog(const char* path);
+            ~SensorLog();
+
+    bool isReady() const;
+    void log(const sensors_event_t* data, int count);
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_SENSOR_LOG_H
@@ -27,19 +27,44 @@
 
 /*****************************************************************************/
 
-TmdSensor::TmdSensor(): SensorBase("/dev/tmd27713", "tmd27713"),
+const evdev_field TmdTraits::fields[] = {
+	{ ABS_DISTANCE, Proximity, EVDEV_BINARY, 0, PROXIMITY_THRESHOLD_GP2A, 0 },
+	{ ABS_MISC,     Light,     EVDEV_SCALED, 0, 1.0f,                     0 },
+};
+const int TmdTraits::numFields = ARRAY_SIZE(TmdTraits::fields);
+
+TmdSensor::TmdSensor(CalibrationStore* store)
+	: EvdevSensor<TmdTraits>("/dev/tmd27713", "tmd27713", 32),
 	mAlsEnabled(0),
-	mProxEnabled(0),
-	mHasPendingEvent(false),
-	mInputReader(32)
+	mProxEnabled(0)
 
 {
-	struct taos_cfg *taos_cfgp;
+	mPendingEvents[Light].sensor = ID_L;
+	mPendingEvents[Light].type = SENSOR_TYPE_LIGHT;
+	mPendingEvents[Proximity].sensor = ID_P;
+	mPendingEvents[Proximity].type = SENSOR_TYPE_PROXIMITY;
 	open_device();
 	if (data_fd >= 0) {
 		ioctl(dev_fd, TAOS_IOCTL_SENSOR_ON, 0);
-		ioctl(dev_fd, TAOS_IOCTL_PROX_CALIBRATE, 0);
-		ioctl(dev_fd, TAOS_IOCTL_ALS_CALIBRATE, 0);
+		calibrate(store);
+	}
+}
+
+/*
+ * The calibration ioctls take a while, so they only run the first time;
+ * the resulting configuration is stored and written back at later opens.
+ */
+void TmdSensor::calibrate(CalibrationStore* store)
+{
+	struct taos_cfg cfg;
+	if (store && store->getLightProx(&cfg, sizeof(cfg)) &&
+			!ioctl(dev_fd, TAOS_IOCTL_CONFIG_SET, &cfg)) {
+		return;
+	}
+	ioctl(dev_fd, TAOS_IOCTL_PROX_CALIBRATE, 0);
+	ioctl(dev_fd, TAOS_IOCTL_ALS_CALIBRATE, 0);
+	if (store && !ioctl(dev_fd, TAOS_IOCTL_CONFIG_GET, &cfg)) {
+		store->setLightProx(&cfg, sizeof(cfg));
 	}
 }
 
@@ -48,12 +73,8 @@ TmdSensor::~TmdSensor(){
 }
 
 int TmdSensor::setInitialState() {
-	struct input_absinfo absinfo;
-    if (!ioctl(data_fd, EVIOCGABS(EVENT_TYPE_PROXIMITY), &absinfo)) {
-        // make sure to report an event immediately
-        mHasPendingEvent = true;
-       mPendingEvent.distance = indexToValue(absinfo.value);
-   }
+	// make sure to report an event immediately
+	readAbsState(1<<Proximity);
 	return 0;
 }
 
@@ -65,6 +86,7 @@ int TmdSensor::setEnable(int32_t handle, int en) {
 		mAlsEnabled = flags;
 		LOGE("\nmAlsEnabled flags = %d\n", flags);
 		if (flags == 1) {
+			mLightFilter.reset();
 			ioctl(dev_fd,TAOS_IOCTL_ALS_ON,0);
 		} else {
 			ioctl(dev_fd,TAOS_IOCTL_ALS_OFF,0);
@@ -74,6 +96,7 @@ int TmdSensor::setEnable(int32_t handle, int en) {
 		mProxEnabled = flags;
 		LOGE("\nmPsEnabled flags = %d\n", flags);
 		if (flags == 1) {
+			mProximityFilter.reset();
 			ioctl(dev_fd,TAOS_IOCTL_PROX_ON,0);
 		} else {
 			ioctl(dev_fd,TAOS_IOCTL_PROX_OFF,0);
@@ -82,64 +105,13 @@ int TmdSensor::setEnable(int32_t handle, int en) {
 	return err;
 }
 
-bool TmdSensor::hasPendingEvents() const {
-	return mHasPendingEvent;
-}
-
-int TmdSensor::readEvents(sensors_event_t* data, int count)
+bool TmdSensor::accept(int id)
 {
-	if (count < 1)
-		return -EINVAL;
-
-	ssize_t n = mInputReader.fill(data_fd);
-	if (n < 0)
-		return n;
-
-	int numEventReceived = 0;
-	input_event const* event;
-
-	while (count && mInputReader.readEvent(&event))
-		{
-		int type = event->type;
-		if (type == EV_ABS) {
-			processEvent(event->code, event->value);
-		} else if (type == EV_SYN) {
-			int64_t time = timevalToNano(event->time);
-			mPendingEvent.timestamp = time;
-			*data++ = mPendingEvent;
-			count--;
-			numEventReceived++;
-		} else {
-			LOGE("Tsl27713 Sensor: unknown event (type=%d, code=%d)",
-				type, event->code);
-			}
-			mInputReader.next();
-		}
-	return numEventReceived;
+	if (id == Light)
+		return mAlsEnabled && mLightFilter.update(mPendingEvents[Light].light);
+	return mProxEnabled && mProximityFilter.update(mPendingEvents[Proximity].distance);
 }
 
-void TmdSensor::processEvent(int code, int value)
-{
-	switch (code) {
-		case ABS_DISTANCE:
-			mPendingEvent.version = sizeof(sensors_event_t);
-			mPendingEvent.sensor = ID_P;
-			mPendingEvent.type = SENSOR_TYPE_PROXIMITY;
-			memset(mPendingEvent.data, 0, sizeof(mPendingEvent.data));
-			mPendingEvent.distance = (value > 0)? 5:0;
-			break;
-		case ABS_MISC:
-			mPendingEvent.version = sizeof(sensors_event_t);
-			mPendingEvent.sensor = ID_L;
-			mPendingEvent.type = SENSOR_TYPE_LIGHT;
-			memset(mPendingEvent.data, 0, sizeof(mPendingEvent.data));
-			mPendingEvent.light = value;
-			break;
-		default:
-			break;
-		}
-
-}
 int TmdSensor::getFd() const
 {
 	return data_fd;
@@ -157,11 +129,6 @@ int TmdSensor::setDelay(int32_t handle, int64_t ns) {
 	return 0;
 };
 
-float TmdSensor::indexToValue(size_t index) const
-{
-    return index * PROXIMITY_THRESHOLD_GP2A;
-}
-
 int64_t TmdSensor::getDelay(int32_t handle)
 {
 	return 0;
@@ -23,41 +23,43 @@
 #include <sys/types.h>
 
 #include "sensors.h"
-#include "SensorBase.h"
-#include "InputEventReader.h"
+#include "EvdevSensor.h"
+#include "OnChangeFilter.h"
+#include "CalibrationStore.h"
 
 /*****************************************************************************/
 #define PROXIMITY_THRESHOLD_GP2A  5.0f
-struct input_event;
 
-class TmdSensor : public SensorBase {
+struct TmdTraits {
+	enum {
+		Light       = 0,
+		Proximity   = 1,
+		numSensors
+	};
+	static const evdev_field fields[];
+	static const int numFields;
+};
+
+class TmdSensor : public EvdevSensor<TmdTraits> {
 public:
-			TmdSensor();
+			TmdSensor(CalibrationStore* store);
 	virtual  ~TmdSensor();
 
 	virtual int setEnable(int32_t handle, int enabled);
-	virtual int readEvents(sensors_event_t* data, int count);
-	virtual bool hasPendingEvents(void) const;
-	void processEvent(int code, int value);
 	int setInitialState(void);
 	int getFd() const;
 	virtual int setDelay(int32_t handle, int64_t ns);
 	 virtual int64_t getDelay(int32_t handle);
 	virtual int  getEnable(int32_t handle);		//rockie
-	float indexToValue(size_t index) const;
 
 	int mAlsEnabled;
 	int mProxEnabled;
-	bool mHasPendingEvent;
 private:
-	 enum {
-	        Light       = 0,
-	        Proximity   = 1,
-	        numSensors
-	    };
-	 int mEnabled[numSensors];
-	InputEventCircularReader mInputReader;
-	sensors_event_t mPendingEvent;
+	LightHysteresis mLightFilter;
+	ProximityDebounce mProximityFilter;
+
+	virtual bool accept(int id);
+	void calibrate(CalibrationStore* store);
 };
 
 
@@ -29,18 +29,27 @@
 
 #include <utils/Atomic.h>
 #include <utils/Log.h>
+#include <cutils/properties.h>
 //#include <linux/akm8963.h>
 #include "sensors.h"
 
 
+#ifdef SENSORHAL_AKM_INPROC
+#include "AkmInprocSensor.h"
+#else
 #include "AkmSensor.h"
+#endif
 #ifdef SENSORHAL_LIGHT_TSL
 #include "TmdSensor.h"
 #else
 #include "LightSensor31XX.h"
 #include "ProximitySensor.h"
+#include "PolledSensor.h"
 #endif
 #include "BmaSensor.h"
+#include "SensorFanout.h"
+#include "CalibrationStore.h"
+#include "SensorLog.h"
 #if defined SENSORHAL_ACC_ADXL346
 #include "AdxlSensor.h"
 #elif defined SENSORHAL_ACC_KXTF9
@@ -54,8 +63,6 @@
 
 #define DELAY_OUT_TIME 0x7FFFFFFF
 
-#define LIGHT_SENSOR_POLLTIME    2000000000
-
 
 #define SENSORS_ACCELERATION     (1<<ID_A)
 #define SENSORS_MAGNETIC_FIELD   (1<<ID_M)
@@ -227,6 +234,9 @@ struct sensors_poll_context_t {
     int setDelay(int handle, int64_t ns);
     int setDelay_sub(int handle, int64_t ns);
     int pollEvents(sensors_event_t* data, int count);
+    int batch(int64_t timeout);
+    int flush();
+    void startFanout();
 
 private:
     enum {
@@ -242,9 +252,36 @@ private:
 
     static const size_t wake = numFds - 1;
     static const char WAKE_MESSAGE = 'W';
+    static const char FLUSH_MESSAGE = 'F';
     struct pollfd mPollFds[numFds];
     int mWritePipeFd;
     SensorBase* mSensors[numSensorDrivers];
+    SensorFanout* mFanout;
+    SensorLog* mLog;
+
+    /* batching state, see batch() */
+    int64_t mBatchTimeout;
+    /* the timeout, limited by batchTimeoutLimit() when armed */
+    int64_t mBatchWindow;
+    int64_t mBatchDeadline;
+    bool mFlushing;
+
+    CalibrationStore mCalibration;
+
+    static bool isContinuous(int drv) { return drv == acc || drv == akm; }
+    static bool isBatchable(int drv) {
+#ifdef SENSORHAL_AKM_INPROC
+        // measures once per timer expiration, nothing queues up while
+        // it is out of the poll set
+        return drv == acc;
+#else
+        return isContinuous(drv);
+#endif
+    }
+    int64_t batchTimeoutLimit();
+    void armBatch();
+    void beginFlush();
+    int batchPollTimeout();
 
 	/* These function will be different depends on 
 	 * which sensor is implemented in AKMD program.
@@ -257,7 +294,16 @@ private:
 /*****************************************************************************/
 
 sensors_poll_context_t::sensors_poll_context_t()
+    : mFanout(0),
+      mLog(0),
+      mBatchTimeout(0),
+      mBatchWindow(0),
+      mBatchDeadline(0),
+      mFlushing(false),
+      mCalibration(SENSORS_CALIBRATION_PATH)
 {
+    mCalibration.load();
+
 #ifdef SENSORHAL_ACC_ADXL346
     mSensors[acc] = new AdxlSensor();
     mPollFds[acc].fd = mSensors[acc]->getFd();
@@ -271,18 +317,22 @@ sensors_poll_context_t::sensors_poll_context_t()
     mPollFds[acc].revents = 0;
 #endif
 
-    mSensors[acc] = new BmaSensor();
+    mSensors[acc] = new BmaSensor(&mCalibration);
     mPollFds[acc].fd = mSensors[acc]->getFd();
     mPollFds[acc].events = POLLIN;
     mPollFds[acc].revents = 0;
 
+#ifdef SENSORHAL_AKM_INPROC
+    mSensors[akm] = new AkmInprocSensor(&mCalibration);
+#else
     mSensors[akm] = new AkmSensor();
+#endif
     mPollFds[akm].fd = mSensors[akm]->getFd();
     mPollFds[akm].events = POLLIN;
     mPollFds[akm].revents = 0;
   //fengxiaoli merger
   #ifdef  SENSORHAL_LIGHT_TSL
-   	mSensors[light] = new TmdSensor();
+   	mSensors[light] = new TmdSensor(&mCalibration);
 	mPollFds[light].fd = mSensors[light]->getFd();
 	mPollFds[light].events = POLLIN;
 	mPollFds[light].revents = 0;
@@ -293,6 +343,18 @@ sensors_poll_context_t::sensors_poll_context_t()
     mPollFds[proximity].revents = 0;
 	
  	mSensors[light] = new LightSensor();
+    char luxPath[PROPERTY_VALUE_MAX];
+    property_get("ro.sensors.als.lux_path", luxPath, LIGHT_SYSFS_LUX_PATH);
+    if (mSensors[light]->getFd() < 0 && luxPath[0]) {
+        // no input device, fall back to sampling the lux attribute
+        PolledLightSensor* polled = new PolledLightSensor(luxPath);
+        if (polled->isAvailable()) {
+            delete mSensors[light];
+            mSensors[light] = polled;
+        } else {
+            delete polled;
+        }
+    }
     mPollFds[light].fd = mSensors[light]->getFd();
     mPollFds[light].events = POLLIN;
     mPollFds[light].revents = 0;
@@ -308,9 +370,21 @@ sensors_poll_context_t::sensors_poll_context_t()
     mPollFds[wake].fd = wakeFds[0];
     mPollFds[wake].events = POLLIN;
     mPollFds[wake].revents = 0;
+
+    char value[PROPERTY_VALUE_MAX];
+    property_get("persist.sensors.log", value, "0");
+    if (atoi(value)) {
+        mLog = new SensorLog(SENSORS_LOG_PATH);
+        if (!mLog->isReady()) {
+            delete mLog;
+            mLog = 0;
+        }
+    }
 }
 
 sensors_poll_context_t::~sensors_poll_context_t() {
+    delete mFanout;
+    delete mLog;
     for (int i=0 ; i<numSensorDrivers ; i++) {
         delete mSensors[i];
     }
@@ -318,6 +392,19 @@ sensors_poll_context_t::~sensors_poll_context_t() {
     close(mWritePipeFd);
 }
 
+void sensors_poll_context_t::startFanout()
+{
+    char value[PROPERTY_VALUE_MAX];
+    property_get("ro.sensors.fanout", value, "0");
+    if (atoi(value)) {
+        mFanout = new SensorFanout(&device);
+        if (!mFanout->isReady()) {
+            delete mFanout;
+            mFanout = 0;
+        }
+    }
+}
+
 int sensors_poll_context_t::handleToDriver(int handle) {
 	switch (handle) {
 		case ID_A:
@@ -359,7 +446,10 @@ int sensors_poll_context_t::activate(int handle, int enabled) {
 	}
 	err = mSensors[drv]->setEnable(handle, enabled);
 
-    if (enabled && !err) {
+    if (mBatchTimeout && !err) {
+        // the batch window depends on the enabled sensors
+        flush();
+    } else if (enabled && !err) {
         const char wakeMessage(WAKE_MESSAGE);
         int result = write(mWritePipeFd, &wakeMessage, 1);
         LOGE_IF(result<0, "error sending wake message (%s)", strerror(errno));
@@ -380,10 +470,19 @@ int sensors_poll_context_t::setDelay(int handle, int64_t ns) {
 			setDelay_sub(ID_M, ns);
 			break;
 
+		case ID_L:
+		case ID_P:
+			break;
+
 		default:
 			return -EINVAL;
 	}
-	return setDelay_sub(handle, ns);
+	int err = setDelay_sub(handle, ns);
+	if (mBatchTimeout && !err) {
+		// and on their delays
+		flush();
+	}
+	return err;
 }
 
 int sensors_poll_context_t::setDelay_sub(int handle, int64_t ns) {
@@ -406,8 +505,101 @@ int sensors_poll_context_t::setDelay_sub(int handle, int64_t ns) {
 	return err;
 }
 
+static int64_t now_ns()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return int64_t(t.tv_sec)*1000000000LL + t.tv_nsec;
+}
+
+/*
+ * While batching is armed, the continuous sensors that read an input
+ * device are left out of the poll set: their samples queue up in the
+ * kernel and don't wake us up.
+ * When the deadline expires, a wakeup sensor fires or flush() is called,
+ * they are put back and drained; batching is re-armed once they are
+ * empty.
+ */
+
+/*
+ * How long the enabled continuous sensors can be held back before their
+ * evdev client buffer overflows, with half of it left for the time it
+ * takes us to drain it.
+ */
+int64_t sensors_poll_context_t::batchTimeoutLimit()
+{
+    static const int handles[] = { ID_A, ID_M, ID_O };
+    int64_t limit = SENSORS_BATCH_MAX_TIMEOUT;
+    for (size_t i=0 ; i<ARRAY_SIZE(handles) ; i++) {
+        const int drv = handleToDriver(handles[i]);
+        if (!isBatchable(drv) || !mSensors[drv]->getEnable(handles[i]))
+            continue;
+        const int reportSize = mSensors[drv]->getReportSize();
+        if (reportSize <= 0)
+            return 0;
+        int64_t delay = mSensors[drv]->getDelay(handles[i]);
+        if (delay < 1000000)
+            delay = 1000000;
+        const int64_t t = delay * (SENSORS_EVDEV_BUFFER_EVENTS / reportSize) / 2;
+        if (t < limit)
+            limit = t;
+    }
+    return limit;
+}
+
+void sensors_poll_context_t::armBatch()
+{
+    const int64_t limit = mBatchTimeout ? batchTimeoutLimit() : 0;
+    mBatchWindow = (limit < mBatchTimeout) ? limit : mBatchTimeout;
+    mFlushing = false;
+    for (int i=0 ; i<numSensorDrivers ; i++) {
+        if (isBatchable(i)) {
+            mPollFds[i].events = mBatchWindow ? 0 : POLLIN;
+        }
+    }
+    mBatchDeadline = now_ns() + mBatchWindow;
+}
+
+void sensors_poll_context_t::beginFlush()
+{
+    mFlushing = true;
+    for (int i=0 ; i<numSensorDrivers ; i++) {
+        mPollFds[i].events = POLLIN;
+    }
+}
+
+int sensors_poll_context_t::batchPollTimeout()
+{
+    if (mFlushing)
+        return 0;
+    if (!mBatchWindow)
+        return -1;
+    int64_t left = mBatchDeadline - now_ns();
+    return (left > 0) ? int((left + 999999) / 1000000) : 0;
+}
+
+int sensors_poll_context_t::batch(int64_t timeout)
+{
+    if (timeout < 0)
+        return -EINVAL;
+    if (timeout > SENSORS_BATCH_MAX_TIMEOUT)
+        timeout = SENSORS_BATCH_MAX_TIMEOUT;
+    mBatchTimeout = timeout;
+    // takes effect once what is buffered so far has been returned
+    return flush();
+}
+
+int sensors_poll_context_t::flush()
+{
+    const char flushMessage(FLUSH_MESSAGE);
+    int result = write(mWritePipeFd, &flushMessage, 1);
+    LOGE_IF(result<0, "error sending flush message (%s)", strerror(errno));
+    return (result < 0) ? -errno : 0;
+}
+
 int sensors_poll_context_t::pollEvents(sensors_event_t* data, int count)
 {
+    sensors_event_t* const events = data;
     int nbEvents = 0;
     int n = 0;
 
@@ -421,9 +613,16 @@ int sensors_poll_context_t::pollEvents(sensors_event_t* data, int count)
                     // no more data for this sensor
                     mPollFds[i].revents = 0;
                 }
+#ifdef SENSORHAL_AKM_INPROC
+			if ((nb > 0) && (acc == i)) {
+				// tilt compensation for the orientation sensor
+				((AkmInprocSensor*)(mSensors[akm]))->setAccel(&data[nb - 1]);
+			}
+#else
 			if ((0 != nb) && (akm == i)) {
 				((BmaSensor*)(mSensors[acc]))->setAccel();
 			}
+#endif
                 count -= nb;
                 nbEvents += nb;
                 data += nb;
@@ -434,7 +633,11 @@ int sensors_poll_context_t::pollEvents(sensors_event_t* data, int count)
             // we still have some room, so try to see if we can get
             // some events immediately or just wait if we don't have
             // anything to return
-            n = poll(mPollFds, numFds, nbEvents ? 0 : -1);
+            if (mBatchWindow && !mFlushing && now_ns() >= mBatchDeadline) {
+                beginFlush();
+            }
+            const int timeout = nbEvents ? 0 : batchPollTimeout();
+            n = poll(mPollFds, numFds, timeout);
             if (n<0) {
                 LOGE("poll() failed (%s)", strerror(errno));
                 return -errno;
@@ -443,13 +646,44 @@ int sensors_poll_context_t::pollEvents(sensors_event_t* data, int count)
                 char msg;
                 int result = read(mPollFds[wake].fd, &msg, 1);
                 LOGE_IF(result<0, "error reading from wake pipe (%s)", strerror(errno));
-                LOGE_IF(msg != WAKE_MESSAGE, "unknown message on wake queue (0x%02x)", int(msg));
+                LOGE_IF(msg != WAKE_MESSAGE && msg != FLUSH_MESSAGE,
+                        "unknown message on wake queue (0x%02x)", int(msg));
                 mPollFds[wake].revents = 0;
+                if (msg == FLUSH_MESSAGE) {
+                    beginFlush();
+                    n = 1;
+                }
+            }
+            if (mBatchWindow && !mFlushing) {
+                bool wakeup = false;
+                for (int i=0 ; i<numSensorDrivers ; i++) {
+                    if (!isContinuous(i) && (mPollFds[i].revents & POLLIN))
+                        wakeup = true;
+                }
+                if (wakeup || (!n && timeout > 0)) {
+                    // deliver the batch along with the wakeup event, or
+                    // because it is due
+                    beginFlush();
+                    n = 1;
+                }
+            } else if (mFlushing && !n && !timeout) {
+                // everything that was held back has been read
+                armBatch();
+                if (!nbEvents) {
+                    // keep waiting, poll() must not return empty-handed
+                    n = 1;
+                }
             }
         }
         // if we have events and space, go read them
     } while (n && count);
 
+    if (mFanout) {
+        mFanout->publish(events, nbEvents);
+    }
+    if (mLog) {
+        mLog->log(events, nbEvents);
+    }
     return nbEvents;
 }
 
@@ -482,6 +716,16 @@ static int poll__poll(struct sensors_poll_device_t *dev,
     return ctx->pollEvents(data, count);
 }
 
+static int poll__batch(struct sensors_poll_device_t *dev, int64_t timeout) {
+    sensors_poll_context_t *ctx = (sensors_poll_context_t *)dev;
+    return ctx->batch(timeout);
+}
+
+static int poll__flush(struct sensors_poll_device_t *dev) {
+    sensors_poll_context_t *ctx = (sensors_poll_context_t *)dev;
+    return ctx->flush();
+}
+
 /*****************************************************************************/
 
 /** Open a new instance of a sensor device using name */
@@ -494,12 +738,16 @@ static int open_sensors(const struct hw_module_t* module, const char* id,
         memset(&dev->device, 0, sizeof(sensors_poll_device_t));
 
         dev->device.common.tag = HARDWARE_DEVICE_TAG;
-        dev->device.common.version  = 0;
+        dev->device.common.version  = SENSORS_DEVICE_API_VERSION_1;
         dev->device.common.module   = const_cast<hw_module_t*>(module);
         dev->device.common.close    = poll__close;
         dev->device.activate        = poll__activate;
         dev->device.setDelay        = poll__setDelay;
         dev->device.poll            = poll__poll;
+        dev->device.batch           = poll__batch;
+        dev->device.flush           = poll__flush;
+
+        dev->startFanout();
 
         *device = &dev->device.common;
         status = 0;
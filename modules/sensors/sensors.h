@@ -103,6 +103,42 @@ __BEGIN_DECLS
 
 #define LIGHT_SENSOR_POLLTIME    2000000000
 
+/*
+ * longest time events can be held back by batch(). Batched samples wait
+ * in the evdev client buffer, which holds SENSORS_EVDEV_BUFFER_EVENTS
+ * input events (the kernel minimum), so the timeout is further limited
+ * by the delay and report size of the enabled sensors.
+ */
+#define SENSORS_BATCH_MAX_TIMEOUT   1000000000LL
+#define SENSORS_EVDEV_BUFFER_EVENTS 64
+
+/* calibration results, see CalibrationStore.h */
+#define SENSORS_CALIBRATION_PATH    "/data/system/sensors_calibration.bin"
+
+/* compressed event log, see SensorLog.h */
+#define SENSORS_LOG_PATH            "/data/system/sensors.slog"
+#define SENSORS_LOG_MAX_SIZE        (4*1024*1024)
+
+/*
+ * lux attribute of light sensors that have no input device, taken from
+ * the ro.sensors.als.lux_path system property. Boards can set a default
+ * with BOARD_SENSORS_LIGHT_LUX_PATH; without either there's no fallback.
+ */
+#ifndef LIGHT_SYSFS_LUX_PATH
+#define LIGHT_SYSFS_LUX_PATH    ""
+#endif
+
+/*
+ * on-change filtering, see OnChangeFilter.h. The defaults can be
+ * overridden with the ro.sensors.als.hysteresis (percent),
+ * ro.sensors.als.min_delta (lux) and ro.sensors.prox.debounce (samples)
+ * system properties.
+ */
+#define LIGHT_HYSTERESIS_PERCENT    10
+#define LIGHT_HYSTERESIS_MIN_LUX    2
+/* only raise this for drivers that keep reporting while the state holds */
+#define PROXIMITY_DEBOUNCE_COUNT    1
+
 /* conversion of magnetic data to uT units */
 #define CONVERT_M                   (0.06f)
 
@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+
+#include <hardware/gralloc.h>
+
+/*
+ * Measures gralloc alloc() and free() for a few typical surface sizes, with
+ * software and GPU-only usage, in the pattern of a BufferQueue being created
+ * and torn down:
+ *      test-allocbench [iterations]
+ * Run it once with debug.gralloc.pool_size=0 to compare with the pool off
+ * (the property is read once per process).
+ *
+ * Before that, the first software write to every byte of a new buffer of
+ * each size, and the page faults it takes. Run it with
+ * debug.gralloc.hugepage=thp and =0 to compare with huge pages on and off.
+ * The host build runs on memfd, see modules/gralloc/backend_host.cpp.
+ */
+
+struct surface_t {
+    int w;
+    int h;
+    char const* name;
+};
+
+static const surface_t sizes[] = {
+    {   64,   64, "icon"     },
+    {  320,  480, "HVGA"     },
+    {  480,  800, "WVGA"     },
+    {  720, 1280, "720p"     },
+    { 1280,  800, "tablet"   },
+};
+
+static const struct {
+    int usage;
+    char const* name;
+} usages[] = {
+    { GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN, "sw"  },
+    // never locked, the allocating process doesn't need to map them
+    { GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_RENDER,          "gpu" },
+};
+
+static const int numBuffers = 3;
+
+static int64_t now()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return int64_t(t.tv_sec)*1000000000LL + t.tv_nsec;
+}
+
+static long minorFaults()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt;
+}
+
+int main(int argc, char** argv)
+{
+    int err;
+    hw_module_t const* module;
+    alloc_device_t* device;
+
+    int iterations = (argc > 1) ? atoi(argv[1]) : 500;
+    if (iterations <= 0) {
+        printf("usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    err = hw_get_module(GRALLOC_HARDWARE_MODULE_ID, &module);
+    if (err != 0) {
+        printf("hw_get_module() failed (%s)\n", strerror(-err));
+        return 0;
+    }
+
+    err = gralloc_open(module, &device);
+    if (err != 0) {
+        printf("gralloc_open() failed (%s)\n", strerror(-err));
+        return 0;
+    }
+
+    const int usage = GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN;
+
+    printf("%-8s %10s %12s %12s\n", "surface", "bytes", "touch (us)", "faults");
+    gralloc_module_t const* gralloc = (gralloc_module_t const*)module;
+    for (size_t s=0 ; s<sizeof(sizes)/sizeof(*sizes) ; s++) {
+        buffer_handle_t handle;
+        int stride;
+        err = device->alloc(device, sizes[s].w, sizes[s].h,
+                HAL_PIXEL_FORMAT_RGBA_8888, usage, &handle, &stride);
+        if (err != 0) {
+            printf("alloc() failed (%s)\n", strerror(-err));
+            return 0;
+        }
+        void* vaddr;
+        err = gralloc->lock(gralloc, handle, GRALLOC_USAGE_SW_WRITE_OFTEN,
+                0, 0, sizes[s].w, sizes[s].h, &vaddr);
+        if (err != 0) {
+            printf("lock() failed (%s)\n", strerror(-err));
+            return 0;
+        }
+        const size_t bytes = size_t(stride) * sizes[s].h * 4;
+        long faults = minorFaults();
+        int64_t t0 = now();
+        memset(vaddr, 0x55, bytes);
+        int64_t t1 = now();
+        faults = minorFaults() - faults;
+        gralloc->unlock(gralloc, handle);
+        device->free(device, handle);
+
+        printf("%-8s %10d %12.1f %12ld\n", sizes[s].name,
+                int(bytes), (t1 - t0) / 1000.0, faults);
+    }
+    printf("\n");
+
+    printf("%-8s %-5s %10s %12s %12s\n", "surface", "usage", "bytes",
+            "alloc (us)", "free (us)");
+    for (size_t u=0 ; u<sizeof(usages)/sizeof(*usages) ; u++) {
+        for (size_t s=0 ; s<sizeof(sizes)/sizeof(*sizes) ; s++) {
+            buffer_handle_t handles[numBuffers];
+            int stride;
+            int64_t allocTime = 0;
+            int64_t freeTime = 0;
+
+            for (int i=0 ; i<iterations ; i++) {
+                int64_t t0 = now();
+                for (int j=0 ; j<numBuffers ; j++) {
+                    err = device->alloc(device, sizes[s].w, sizes[s].h,
+                            HAL_PIXEL_FORMAT_RGBA_8888, usages[u].usage,
+                            &handles[j], &stride);
+                    if (err != 0) {
+                        printf("alloc() failed (%s)\n", strerror(-err));
+                        return 0;
+                    }
+                }
+                int64_t t1 = now();
+                for (int j=0 ; j<numBuffers ; j++) {
+                    device->free(device, handles[j]);
+                }
+                int64_t t2 = now();
+                allocTime += t1 - t0;
+                freeTime += t2 - t1;
+            }
+
+            const double n = double(iterations) * numBuffers * 1000.0;
+            printf("%-8s %-5s %10d %12.1f %12.1f\n", sizes[s].name,
+                    usages[u].name, sizes[s].w * sizes[s].h * 4,
+                    allocTime / n, freeTime / n);
+        }
+    }
+
+    err = gralloc_close(device);
+    if (err != 0) {
+        printf("gralloc_close() failed (%s)\n", strerror(-err));
+    }
+    return 0;
+}
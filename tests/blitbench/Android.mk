@@ -0,0 +1,35 @@
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	blitbench.cpp \
+	../../modules/gralloc/blit.cpp
+
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/../../modules/gralloc
+
+ifeq ($(ARCH_ARM_HAVE_NEON),true)
+LOCAL_ARM_NEON := true
+endif
+
+LOCAL_MODULE:= test-blitbench
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
+# the same benchmark, for the SSE2 kernels
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	blitbench.cpp \
+	../../modules/gralloc/blit.cpp
+
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/../../modules/gralloc
+
+LOCAL_MODULE:= blitbench
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
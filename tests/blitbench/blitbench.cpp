@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include "blit.h"
+
+/*
+ * Throughput of the gralloc blitter, full frames between a buffer with
+ * 4-byte aligned rows and a framebuffer with padded rows, against a plain
+ * memcpy of the same size:
+ *      blitbench [width height [iterations]]
+ * The SIMD results are also checked against the C kernels.
+ *
+ * Then the effect of the row alignment gralloc picks on software rendering
+ * and on the blit, with a width one pixel short of the requested one so
+ * that rows aren't naturally aligned.
+ */
+
+struct conversion_t {
+    char const* name;
+    int dst;
+    int src;
+};
+
+static const conversion_t conversions[] = {
+    { "RGBA_8888 -> RGBX_8888", HAL_PIXEL_FORMAT_RGBX_8888, HAL_PIXEL_FORMAT_RGBA_8888 },
+    { "RGB_565   -> RGB_565  ", HAL_PIXEL_FORMAT_RGB_565,   HAL_PIXEL_FORMAT_RGB_565   },
+    { "RGBA_8888 -> RGB_565  ", HAL_PIXEL_FORMAT_RGB_565,   HAL_PIXEL_FORMAT_RGBA_8888 },
+    { "BGRA_8888 -> RGB_565  ", HAL_PIXEL_FORMAT_RGB_565,   HAL_PIXEL_FORMAT_BGRA_8888 },
+    { "BGRA_8888 -> RGBX_8888", HAL_PIXEL_FORMAT_RGBX_8888, HAL_PIXEL_FORMAT_BGRA_8888 },
+    { "RGB_565   -> RGBX_8888", HAL_PIXEL_FORMAT_RGBX_8888, HAL_PIXEL_FORMAT_RGB_565   },
+};
+
+static const struct {
+    char const* name;
+    int flags;
+} variants[] = {
+    { "C",      BLIT_NO_SIMD     },
+    { "SIMD",   0                },
+    { "SIMD/NT", BLIT_NONTEMPORAL },
+};
+
+static const size_t alignments[] = { 4, 16, 64 };
+
+static const int alignmentFormats[] = {
+    HAL_PIXEL_FORMAT_RGBX_8888,
+    HAL_PIXEL_FORMAT_RGB_565,
+};
+
+static int64_t now()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return int64_t(t.tv_sec)*1000000000LL + t.tv_nsec;
+}
+
+static double gbps(size_t bytes, int iterations, int64_t ns)
+{
+    return double(bytes) * iterations / ns;
+}
+
+int main(int argc, char** argv)
+{
+    const int w = (argc > 2) ? atoi(argv[1]) : 720;
+    const int h = (argc > 2) ? atoi(argv[2]) : 1280;
+    const int iterations = (argc > 3) ? atoi(argv[3]) : 100;
+    if (w <= 0 || h <= 0 || iterations <= 0) {
+        printf("usage: %s [width height [iterations]]\n", argv[0]);
+        return 1;
+    }
+
+    // the destination rows are padded as a framebuffer's often are
+    const size_t maxSize = (size_t(w)*4 + 128) * h;
+    uint8_t* src = (uint8_t*)malloc(maxSize);
+    uint8_t* dst = (uint8_t*)malloc(maxSize);
+    uint8_t* ref = (uint8_t*)malloc(maxSize);
+    if (!src || !dst || !ref) {
+        printf("out of memory\n");
+        return 1;
+    }
+    for (size_t i=0 ; i<maxSize ; i++)
+        src[i] = uint8_t(rand());
+
+    printf("%d x %d, %d iterations, GB/s written\n", w, h, iterations);
+
+    for (size_t c=0 ; c<sizeof(conversions)/sizeof(*conversions) ; c++) {
+        blit_buffer_t s, d;
+        s.base = src;
+        s.format = conversions[c].src;
+        s.bpr = (w * blitBytesPerPixel(s.format) + 3) & ~3;
+        d.base = dst;
+        d.format = conversions[c].dst;
+        d.bpr = ((w * blitBytesPerPixel(d.format) + 63) & ~63) + 64;
+        const size_t written = size_t(w) * h * blitBytesPerPixel(d.format);
+
+        int64_t t0 = now();
+        for (int i=0 ; i<iterations ; i++)
+            memcpy(dst, src, written);
+        const int64_t memcpyTime = now() - t0;
+
+        // reference output
+        blit_buffer_t r = d;
+        r.base = ref;
+        memset(ref, 0, maxSize);
+        blitRect(&r, &s, 0, 0, w, h, BLIT_NO_SIMD);
+
+        printf("%s  memcpy %6.2f", conversions[c].name,
+                gbps(written, iterations, memcpyTime));
+        for (size_t v=0 ; v<sizeof(variants)/sizeof(*variants) ; v++) {
+            memset(dst, 0, maxSize);
+            t0 = now();
+            for (int i=0 ; i<iterations ; i++) {
+                if (blitRect(&d, &s, 0, 0, w, h, variants[v].flags) < 0) {
+                    printf("  unsupported\n");
+                    return 1;
+                }
+            }
+            const int64_t time = now() - t0;
+            const bool ok = !memcmp(dst, ref, d.bpr * h);
+            printf("  %s %6.2f%s", variants[v].name,
+                    gbps(written, iterations, time), ok ? "" : " (MISMATCH)");
+        }
+        printf("\n");
+    }
+
+    const int aw = w - 1;
+    printf("\n%d x %d, row alignment, GB/s written\n", aw, h);
+    for (size_t f=0 ; f<sizeof(alignmentFormats)/sizeof(*alignmentFormats) ; f++) {
+        const int format = alignmentFormats[f];
+        const size_t bpp = blitBytesPerPixel(format);
+        const size_t written = size_t(aw) * h * bpp;
+
+        // the framebuffer keeps the same layout
+        blit_buffer_t d;
+        d.base = dst;
+        d.format = format;
+        d.bpr = ((aw * bpp + 63) & ~63) + 64;
+
+        for (size_t a=0 ; a<sizeof(alignments)/sizeof(*alignments) ; a++) {
+            blit_buffer_t s;
+            s.base = src;
+            s.format = format;
+            s.bpr = (aw * bpp + alignments[a] - 1) / alignments[a] * alignments[a];
+
+            // software rendering, one row at a time
+            int64_t t0 = now();
+            for (int i=0 ; i<iterations ; i++) {
+                for (int y=0 ; y<h ; y++)
+                    memset((uint8_t*)s.base + y*s.bpr, i + y, aw * bpp);
+            }
+            const int64_t renderTime = now() - t0;
+
+            t0 = now();
+            for (int i=0 ; i<iterations ; i++)
+                blitRect(&d, &s, 0, 0, aw, h, BLIT_NONTEMPORAL);
+            const int64_t blitTime = now() - t0;
+
+            printf("%-9s align %2d  render %6.2f  blit %6.2f\n",
+                    (bpp == 4) ? "RGBX_8888" : "RGB_565", int(alignments[a]),
+                    gbps(written, iterations, renderTime),
+                    gbps(written, iterations, blitTime));
+        }
+    }
+
+    free(src);
+    free(dst);
+    free(ref);
+    return 0;
+}
@@ -0,0 +1,33 @@
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	framepacing.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+	libcutils libhardware
+
+LOCAL_MODULE:= test-framepacing
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
+# the same benchmark on the build host, on the host backend of gralloc
+ifeq ($(HOST_OS),linux)
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	framepacing.cpp
+
+LOCAL_STATIC_LIBRARIES := \
+	libgralloc_host libcutils liblog
+
+LOCAL_LDLIBS := -lpthread -lrt
+
+LOCAL_MODULE:= framepacing
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+endif # HOST_OS == linux
@@ -0,0 +1,254 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include <hardware/gralloc.h>
+#include <hardware/fb.h>
+
+/*
+ * Posts frames to the framebuffer HAL under a synthetic render load and
+ * counts the frames that missed their vsync:
+ *      test-framepacing [frames] [load %] [spike every n frames] [async]
+ * With "async" the frames are posted with postAsync(), and a buffer is
+ * rendered to again once its release fd says it has left the screen.
+ * Each frame takes <load> percent of a refresh period to render, and every
+ * n-th frame takes one and a half periods. A frame is counted as dropped
+ * when it is displayed more than half a period late. Stop SurfaceFlinger
+ * first, and compare runs with debug.gralloc.num_buffers=2 and 3.
+ * The host build posts to an emulated 60 Hz display, see
+ * modules/gralloc/backend_host.cpp.
+ */
+
+static int64_t now()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return int64_t(t.tv_sec)*1000000000LL + t.tv_nsec;
+}
+
+/* renders for <duration> ns, touching the first rows of the buffer */
+static void render(void* vaddr, size_t bpr, int rows, int64_t duration)
+{
+    const int64_t end = now() + duration;
+    int row = 0;
+    do {
+        memset((uint8_t*)vaddr + row*bpr, row, bpr);
+        row = (row + 1) % rows;
+    } while (now() < end);
+}
+
+/*
+ * In async mode, reads the release fd of every post in turn and records
+ * when each frame made it to the screen.
+ */
+struct observer_t {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int* fds;
+    int64_t* shown;
+    int frames;
+    int posted;
+    int completed;
+};
+
+static void* observe(void* arg)
+{
+    observer_t* o = (observer_t*)arg;
+    for (int i=0 ; i<o->frames ; i++) {
+        pthread_mutex_lock(&o->lock);
+        while (o->posted <= i)
+            pthread_cond_wait(&o->cond, &o->lock);
+        const int fd = o->fds[i];
+        pthread_mutex_unlock(&o->lock);
+
+        if (fd >= 0) {
+            uint64_t value;
+            read(fd, &value, sizeof(value));
+            close(fd);
+        }
+        const int64_t t = now();
+
+        pthread_mutex_lock(&o->lock);
+        o->shown[i] = t;
+        o->completed = i + 1;
+        pthread_cond_broadcast(&o->cond);
+        pthread_mutex_unlock(&o->lock);
+    }
+    return NULL;
+}
+
+int main(int argc, char** argv)
+{
+    int err;
+    hw_module_t const* module;
+    framebuffer_device_t* fb;
+    alloc_device_t* alloc;
+
+    const int frames = (argc > 1) ? atoi(argv[1]) : 600;
+    const int load = (argc > 2) ? atoi(argv[2]) : 70;
+    const int spike = (argc > 3) ? atoi(argv[3]) : 10;
+    const bool async = (argc > 4) && !strcmp(argv[4], "async");
+    if (frames <= 0 || load < 0 || spike <= 0) {
+        printf("usage: %s [frames] [load %%] [spike every n frames] [async]\n",
+                argv[0]);
+        return 1;
+    }
+
+    err = hw_get_module(GRALLOC_HARDWARE_MODULE_ID, &module);
+    if (err != 0) {
+        printf("hw_get_module() failed (%s)\n", strerror(-err));
+        return 0;
+    }
+
+    err = framebuffer_open(module, &fb);
+    if (err != 0) {
+        printf("framebuffer_open() failed (%s)\n", strerror(-err));
+        return 0;
+    }
+
+    err = gralloc_open(module, &alloc);
+    if (err != 0) {
+        printf("gralloc_open() failed (%s)\n", strerror(-err));
+        return 0;
+    }
+
+    if (async && (fb->common.version < FRAMEBUFFER_DEVICE_API_VERSION_1 ||
+            !fb->postAsync)) {
+        printf("postAsync() not supported\n");
+        return 0;
+    }
+
+    const gralloc_module_t* gralloc = (const gralloc_module_t*)module;
+    const int numBuffers = fb->numFramebuffers;
+    const int64_t period = int64_t(1000000000.0 / fb->fps);
+    buffer_handle_t* buffers = new buffer_handle_t[numBuffers];
+    int stride;
+    for (int i=0 ; i<numBuffers ; i++) {
+        err = alloc->alloc(alloc, fb->width, fb->height, fb->format,
+                GRALLOC_USAGE_HW_FB | GRALLOC_USAGE_SW_WRITE_OFTEN,
+                &buffers[i], &stride);
+        if (err != 0) {
+            printf("alloc() failed (%s)\n", strerror(-err));
+            return 0;
+        }
+    }
+    const size_t bpr = stride * ((fb->format == HAL_PIXEL_FORMAT_RGB_565) ? 2 : 4);
+
+    printf("%u x %u, %.2f fps, %d framebuffers, load %d%%, spike every %d%s\n",
+            fb->width, fb->height, fb->fps, numBuffers, load, spike,
+            async ? ", async" : "");
+
+    observer_t observer;
+    pthread_mutex_init(&observer.lock, NULL);
+    pthread_cond_init(&observer.cond, NULL);
+    observer.fds = new int[frames];
+    observer.shown = new int64_t[frames];
+    observer.frames = frames;
+    observer.posted = 0;
+    observer.completed = 0;
+    pthread_t observerThread;
+    if (async)
+        pthread_create(&observerThread, NULL, observe, &observer);
+
+    int posted = 0;
+    const int64_t start = now();
+    for (int i=0 ; i<frames ; i++) {
+        buffer_handle_t buffer = buffers[i % numBuffers];
+        void* vaddr;
+        int64_t duration = (period * load) / 100;
+        if (i % spike == spike - 1)
+            duration = period + period/2;
+
+        if (async && i >= numBuffers) {
+            // the buffer left the screen when the frame after it was shown,
+            // a single buffer is free once it's been copied to the screen
+            const int needed = (numBuffers > 1) ? i - numBuffers + 2 : i;
+            pthread_mutex_lock(&observer.lock);
+            while (observer.completed < needed)
+                pthread_cond_wait(&observer.cond, &observer.lock);
+            pthread_mutex_unlock(&observer.lock);
+        }
+
+        gralloc->lock(gralloc, buffer, GRALLOC_USAGE_SW_WRITE_OFTEN,
+                0, 0, fb->width, fb->height, &vaddr);
+        render(vaddr, bpr, 16, duration);
+        gralloc->unlock(gralloc, buffer);
+
+        if (async) {
+            int releaseFd;
+            err = fb->postAsync(fb, buffer, &releaseFd);
+            if (err == 0) {
+                pthread_mutex_lock(&observer.lock);
+                observer.fds[i] = releaseFd;
+                observer.posted = i + 1;
+                pthread_cond_broadcast(&observer.cond);
+                pthread_mutex_unlock(&observer.lock);
+            }
+        } else {
+            err = fb->post(fb, buffer);
+            observer.shown[i] = now();
+        }
+        if (err != 0) {
+            printf("post() failed (%s)\n", strerror(-err));
+            break;
+        }
+        posted++;
+    }
+
+    if (async) {
+        // let the observer go through the frames that were never posted
+        pthread_mutex_lock(&observer.lock);
+        for (int i=posted ; i<frames ; i++)
+            observer.fds[i] = -1;
+        observer.posted = frames;
+        pthread_cond_broadcast(&observer.cond);
+        pthread_mutex_unlock(&observer.lock);
+        pthread_join(observerThread, NULL);
+    }
+    const int64_t elapsed = now() - start;
+
+    int dropped = 0;
+    int64_t worst = 0;
+    for (int i=1 ; i<posted ; i++) {
+        const int64_t interval = observer.shown[i] - observer.shown[i-1];
+        if (interval > period + period/2)
+            dropped += int((interval + period/2) / period) - 1;
+        if (interval > worst)
+            worst = interval;
+    }
+
+    printf("%d frames in %.2f s (%.2f fps), %d dropped, worst interval %.2f ms\n",
+            posted, elapsed / 1e9, posted * 1e9 / elapsed, dropped, worst / 1e6);
+    delete [] observer.fds;
+    delete [] observer.shown;
+
+    for (int i=0 ; i<numBuffers ; i++) {
+        alloc->free(alloc, buffers[i]);
+    }
+    delete [] buffers;
+    gralloc_close(alloc);
+    framebuffer_close(fb);
+    return 0;
+}
@@ -0,0 +1,26 @@
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	sensorlog.cpp
+
+LOCAL_MODULE:= test-sensorlog
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
+# the same decoder, to read logs pulled off a device
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	sensorlog.cpp
+
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/../../include
+
+LOCAL_MODULE:= sensorlog
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
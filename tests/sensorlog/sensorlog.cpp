@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include <hardware/sensors_log.h>
+
+/*
+ * Decodes a log written by the sensors HAL (persist.sensors.log=1) and
+ * prints one event per line:
+ *      sensorlog /data/system/sensors.slog
+ */
+
+struct state_t {
+    bool valid;
+    int32_t type;
+    uint32_t count;
+    int32_t status;
+    int64_t timestamp;
+    int64_t delta;
+    int64_t values[SENSORS_LOG_MAX_VALUES];
+};
+
+static const uint8_t* getSigned(const uint8_t* p, const uint8_t* end,
+        int64_t* v)
+{
+    uint64_t u;
+    p = sensors_log_get_varint(p, end, &u);
+    if (p)
+        *v = sensors_log_unzigzag(u);
+    return p;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <log file>\n", argv[0]);
+        return 1;
+    }
+
+    FILE* f = fopen(argv[1], "rb");
+    if (!f) {
+        fprintf(stderr, "couldn't open %s (%s)\n", argv[1], strerror(errno));
+        return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t* buffer = (uint8_t*)malloc(size);
+    if (!buffer || fread(buffer, 1, size, f) != size_t(size)) {
+        fprintf(stderr, "couldn't read %s\n", argv[1]);
+        return 1;
+    }
+    fclose(f);
+
+    sensors_log_header header;
+    if (size < long(sizeof(header))) {
+        fprintf(stderr, "%s: truncated header\n", argv[1]);
+        return 1;
+    }
+    memcpy(&header, buffer, sizeof(header));
+    if (header.magic != SENSORS_LOG_MAGIC ||
+            header.version != SENSORS_LOG_VERSION || !header.scale) {
+        fprintf(stderr, "%s: not a sensors log\n", argv[1]);
+        return 1;
+    }
+
+    static state_t state[SENSORS_LOG_MAX_HANDLES];
+    const uint8_t* p = buffer + sizeof(header);
+    const uint8_t* const end = buffer + size;
+    // the end of the last record decoded
+    const uint8_t* good = p;
+    long numEvents = 0;
+
+    while (p && p < end) {
+        const uint8_t tag = *p++;
+        const int handle = tag & ~SENSORS_LOG_KEY;
+        if (handle >= SENSORS_LOG_MAX_HANDLES) {
+            fprintf(stderr, "bad handle %d at offset %ld\n",
+                    handle, long(p - 1 - buffer));
+            break;
+        }
+        state_t& s = state[handle];
+
+        if (tag & SENSORS_LOG_KEY) {
+            uint64_t type, count;
+            int64_t status;
+            p = sensors_log_get_varint(p, end, &type);
+            if (p) p = sensors_log_get_varint(p, end, &count);
+            if (p) p = getSigned(p, end, &status);
+            if (p) p = getSigned(p, end, &s.timestamp);
+            if (!p || count > SENSORS_LOG_MAX_VALUES)
+                break;
+            for (uint32_t i=0 ; p && i<count ; i++)
+                p = getSigned(p, end, &s.values[i]);
+            s.valid = true;
+            s.type = type;
+            s.count = count;
+            s.status = status;
+            s.delta = 0;
+        } else {
+            if (!s.valid) {
+                // can't happen unless the file was cut at the front
+                break;
+            }
+            int64_t dd;
+            p = getSigned(p, end, &dd);
+            if (!p)
+                break;
+            s.delta += dd;
+            s.timestamp += s.delta;
+            for (uint32_t i=0 ; p && i<s.count ; i++) {
+                int64_t d;
+                p = getSigned(p, end, &d);
+                s.values[i] += d;
+            }
+        }
+        if (!p)
+            break;
+
+        printf("sensor=%d, type=%d, time=%lld, status=%d, value=<",
+                handle, s.type, (long long)s.timestamp, s.status);
+        for (uint32_t i=0 ; i<s.count ; i++) {
+            printf(i ? ",%.3f" : "%.3f", double(s.values[i]) / header.scale);
+        }
+        printf(">\n");
+        numEvents++;
+        good = p;
+    }
+
+    if (good != end) {
+        // records aren't delimited, nothing after this one can be decoded
+        fprintf(stderr, "%s: truncated or corrupted record at offset %ld\n",
+                argv[1], long(good - buffer));
+    }
+    fprintf(stderr, "%ld events, %ld bytes (%.1f bytes/event)\n",
+            numEvents, size, numEvents ? double(size) / numEvents : 0.0);
+    free(buffer);
+    return 0;
+}